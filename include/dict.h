@@ -1,171 +1,156 @@
 #include <cstdint>
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <algorithm>
 #include "entry.h"
 #include "hashTable.h"
+#include "hash.h"
+#include "swissTable.h"
 
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 
+// the whole keyspace of a shard lives in one Swiss table, see swissTable.h
+// strings and lists alike, entries carry their type, short keys and values sit in the slot
+struct KeyspacePolicy{
+    using Key = std::string_view;
+    using Probe = TriangularProbe;
 
-StringHashTable StringTable = {new Entry[1024], 0, 1024};
+    static constexpr size_t MAX_LOAD_PERCENT = 87;
+    static constexpr size_t REHASH_STEP = 16;
 
-
-
-size_t getStringIndex(std::string key);
-void resizeStringTable(size_t new_capacity);
-
-std::uint64_t generateStringHash(const char* key, size_t len){
-    uint64_t hash = 14695981039346656037ull;
-    for(size_t i = 0; i < len; ++i){
-        hash^= static_cast<uint64_t>(key[i]);
-        hash*= 1099511628211ull;
-    }
-
-    return hash;
-}
-
-
-const char* getString(std::string key){
-    uint64_t hash = generateStringHash(key.c_str(), key.length());
-    size_t index = hash % StringTable.capacity;
-    
-
-    while(StringTable.entries[index].key != nullptr && std::strcmp(StringTable.entries[index].key, key.c_str()) != 0){ // strcmp returns 0 if both values are same
-        index = (index + 1) % StringTable.capacity;
+    // entries cache their hash, migration never touches key bytes
+    static uint64_t hash(const Entry& e){
+        return e.hash;
     }
 
-    if(StringTable.entries[index].key == nullptr){
-        return nullptr;
-    }
-
-    return StringTable.entries[index].value;
-}
-
-void setString(std::string key, std::string value){
-
-    if (StringTable.size >= (StringTable.capacity * 0.75)){
-        //resizeStringTable
-        resizeStringTable(StringTable.capacity*2);
-
-    }
-    size_t index = getStringIndex(key);
-
-    // uint64_t hash = generateStringHash(key.c_str(), key.length());
-
-    // size_t index = hash % StringTable.capacity; // StringTable size = StringTable.capacity
-
-    while(StringTable.entries[index].key != nullptr && std::strcmp(StringTable.entries[index].key, key.c_str()) != 0){
-        index = (index + 1) % StringTable.capacity;
+    // the full hash almost always settles it before the key bytes are compared
+    static bool matches(const Entry& e, std::string_view key, uint64_t hash){
+        return e.hash == hash && e.key_len == key.size() && std::memcmp(entryBytes(e), key.data(), key.size()) == 0;
     }
-    
-    Entry *e = &StringTable.entries[index];
 
-    //delete data if key value already exists
-    
-    if(e->key == nullptr) ++StringTable.size;
-    
-    if (e->key != nullptr) delete[] e->key;
-    if (e->value != nullptr) delete[] e->value;
+    static void release(Entry& e);
+};
 
+// every shard thread owns its own table, the keyspace is partitioned by key hash
+// so a table is only ever touched by the thread it belongs to and needs no lock
+thread_local SwissTable<Entry, KeyspacePolicy> Keyspace(KeyspaceCapacity);
 
 
-    e->key = new char[key.size() + 1];
-    e->value = new char[value.size() + 1];
+// what a lookup found, commands turn WrongType into a WRONGTYPE error
+enum class KeyResult{
+    Found,
+    MissingKey,
+    WrongType,
+    OutOfRange,
+    TooLarge        // the key or the value would pass ENTRY_MAX_BYTES, nothing was changed
+};
 
+// defined with the list encoding in llist.h
+struct List;
+void freeList(List* list);
 
-    std::strcpy(e->key, key.c_str());
-    std::strcpy(e->value, value.c_str());
-
+// frees whatever the entry owns, its object included
+void KeyspacePolicy::release(Entry& e){
+    if(e.type == EntryType::List && !e.packed) freeList(entryObject<List>(e));
+    freeEntry(e);
+}
 
+// the single lookup every command starts with, also moves a migration along
+Entry* lookupKey(std::string_view key, uint64_t hash){
+    return Keyspace.find(key, hash);
 }
 
-std::string getKeys(){
+// the key must not be in the keyspace yet
+Entry* addEntry(const Entry& entry){
+    return Keyspace.insert(entry);
+}
 
-    std::string result = "";
 
-    if(StringTable.size == 0) return "\n";
+// value points into the table, only valid until it is modified
+KeyResult getString(std::string_view key, std::string_view& value){
+    Entry* e = lookupKey(key, hashKey(key));
+    if(e == nullptr) return KeyResult::MissingKey;
+    if(e->type != EntryType::String) return KeyResult::WrongType;
 
-    for(int i = 0; i < StringTable.capacity; ++i){
-        if(StringTable.entries[i].key != nullptr){
-            result.append(StringTable.entries[i].key);
-            result.append(" ");
-        }
-    }
-    return result;
+    value = entryValue(*e);
+    return KeyResult::Found;
 }
 
-bool delKey(std::string key){
-    size_t index = getStringIndex(key);
-    
-    if(index == StringTable.capacity) return false;
+// like SET it replaces a key of any type
+KeyResult setString(std::string_view key, std::string_view value){
+    if(entryTooLarge(key.size(), value.size())) return KeyResult::TooLarge;
 
-    delete[] StringTable.entries[index].key;
-    delete[] StringTable.entries[index].value;
-    StringTable.entries[index] = Entry{};
+    // a key that has not been migrated yet is updated where it is
+    uint64_t hash = hashKey(key);
+    Entry* e = lookupKey(key, hash);
 
-    return true;
+    //overwrite data if key value already exists
+    if(e != nullptr && e->type == EntryType::String){
+        setEntryValue(*e, value);
+        return KeyResult::Found;
+    }
+    if(e != nullptr){
+        KeyspacePolicy::release(*e);
+        *e = makeEntry(key, value, hash);
+        return KeyResult::Found;
+    }
 
+    addEntry(makeEntry(key, value, hash));
+    return KeyResult::Found;
 }
 
-size_t getStringIndex(std::string key){
-    uint64_t hash = generateStringHash(key.c_str(), key.length());
-
-    size_t index = hash % StringTable.capacity; // StringTable size = StringTable.capacity
+// length is the length of the value after appending
+KeyResult appendString(std::string_view key, std::string_view value, size_t& length){
+    uint64_t hash = hashKey(key);
+    Entry* e = lookupKey(key, hash);
+    if(e == nullptr){
+        if(entryTooLarge(key.size(), value.size())) return KeyResult::TooLarge;
+        addEntry(makeEntry(key, value, hash));
+        length = value.size();
+        return KeyResult::Found;
+    }
+    if(e->type != EntryType::String) return KeyResult::WrongType;
+    if(entryTooLarge(key.size(), e->value_len + value.size())) return KeyResult::TooLarge;
 
-    size_t attempts = 0;
+    appendEntryValue(*e, value);
+    length = e->value_len;
+    return KeyResult::Found;
+}
 
-    while(StringTable.entries[index].key != nullptr && std::strcmp(StringTable.entries[index].key, key.c_str()) != 0){
-        index = (index + 1) % StringTable.capacity;
-        ++attempts;
-        if(attempts >= StringTable.capacity)return StringTable.capacity;
-    }
+// views point into the table, only valid until it is modified
+void getKeys(std::vector<std::string_view>& keys, EntryType type){
+    keys.clear();
+    Keyspace.for_each([&](const Entry& e){
+        if(e.type == type) keys.push_back(entryKey(e));
+    });
+}
 
-    return index;    
+// removes a key of any type
+bool delKey(std::string_view key){
+    return Keyspace.erase(key, hashKey(key));
 }
 
-void resizeStringTable(size_t new_capacity)
-{
-    Entry* oldTable = StringTable.entries;
-    size_t oldCapacity = StringTable.capacity;
-
-    StringTable.entries = new Entry[new_capacity];
-    StringTable.capacity = new_capacity;
-    StringTable.size = 0;
-
-    for(size_t i = 0; i < oldCapacity; ++i){
-    
-        if(oldTable[i].key != nullptr){
-
-            char* key = oldTable[i].key;
-            char* value = oldTable[i].value;
-            
-            uint64_t hash = generateStringHash(key, std::strlen(key));
-
-            size_t index = hash%StringTable.capacity;
-
-            while(StringTable.entries[i].key != nullptr)
-            {
-                index = (index+1) % StringTable.capacity;
-            }
-            
-            StringTable.entries[i].key = key;
-            StringTable.entries[i].value = value;
-            ++StringTable.size;                       
-        }
-    }
+bool keyspaceRehashing(){
+    return Keyspace.rehashing();
+}
 
-    delete[] oldTable;
+// idle time migration, gives up once the budget is spent
+void rehashKeyspaceFor(std::chrono::microseconds budget){
+    Keyspace.rehash_for(budget);
 }
 
 void getSnapDict(rapidjson::Writer<rapidjson::StringBuffer>& writer)
 {
-
-    for(int i = 0; i < StringTable.capacity; i++)
-    {
-        if (StringTable.entries[i].key == nullptr) continue;
-        writer.Key(StringTable.entries[i].key);
-        writer.String(StringTable.entries[i].value);
-    }
-
-}
\ No newline at end of file
+    Keyspace.for_each([&](const Entry& e){
+        if(e.type != EntryType::String) return;
+        std::string_view key = entryKey(e), value = entryValue(e);
+        writer.Key(key.data(), key.size());
+        writer.String(value.data(), value.size());
+    });
+}
@@ -0,0 +1,73 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+// compile time perfect hash over the command names
+// a command is found with one hash of its length and first, second and last byte,
+// one table load and one case-insensitive compare, no matter how many commands exist
+
+constexpr size_t DISPATCH_SLOTS = 64;
+
+
+constexpr char upperAscii(char c){
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+constexpr uint32_t commandHash(std::string_view name, uint32_t seed){
+    uint32_t h = seed;
+    uint32_t parts[4] = {
+        (uint32_t) name.size(),
+        (uint32_t)(unsigned char) upperAscii(name[0]),
+        (uint32_t)(unsigned char) upperAscii(name[name.size() > 1 ? 1 : 0]),
+        (uint32_t)(unsigned char) upperAscii(name[name.size() - 1])
+    };
+    for(uint32_t part: parts){
+        h = (h ^ part) * 0x9E3779B1u;
+        h ^= h >> 15;
+    }
+    return h;
+}
+
+constexpr size_t commandSlot(std::string_view name, uint32_t seed){
+    return commandHash(name, seed) & (DISPATCH_SLOTS - 1);
+}
+
+struct DispatchTable{
+    uint32_t seed;
+    uint8_t slots[DISPATCH_SLOTS];  // command index + 1, 0 means empty
+};
+
+// tries seeds until every name lands in its own slot, fails to compile if none does
+template<class Spec, size_t N>
+constexpr DispatchTable buildDispatchTable(const Spec (&specs)[N]){
+    static_assert(N < DISPATCH_SLOTS, "grow DISPATCH_SLOTS to add more commands");
+
+    for(uint32_t seed = 1; seed < 100000; ++seed){
+        DispatchTable table{seed, {}};
+        bool collision = false;
+
+        for(size_t i = 0; i < N && !collision; ++i){
+            size_t slot = commandSlot(specs[i].name, seed);
+            if(table.slots[slot] != 0){
+                collision = true;
+            }else{
+                table.slots[slot] = (uint8_t)(i + 1);
+            }
+        }
+        if(!collision) return table;
+    }
+
+    throw "no perfect hash seed found for the command table";
+}
+
+// index into the spec array, or -1 when the name cannot be a known command
+// the caller still has to compare the name against the spec it gets back
+constexpr int lookupCommand(const DispatchTable& table, std::string_view name){
+    if(name.empty()) return -1;
+    return (int) table.slots[commandSlot(name, table.seed)] - 1;
+}
+
+#endif
@@ -1,6 +1,190 @@
+#include <stdint.h>
+#include <cstring>
+#include <string_view>
+#include <algorithm>
+#include "slab.h"
 
 
+// key and value are stored back to back, each followed by a NUL for printing
+// when both fit they live in the slot itself, a hit reads one cache line and a short
+// SET allocates nothing, larger pairs share a single slab chunk
+// a list's value bytes are the pointer to its list object
+constexpr size_t ENTRY_INLINE_BYTES = 40;
+
+// a chunk is kept for a smaller value as long as the value still uses a quarter of it
+constexpr size_t ENTRY_SHRINK_RATIO = 4;
+
+// longest key or value SET and APPEND accept, like Redis
+// with the doubling reserve a chunk stays far below the 4 GiB its 32 bit lengths can describe
+constexpr size_t ENTRY_MAX_BYTES = 512 * 1024 * 1024;
+
+inline bool entryTooLarge(size_t key_len, size_t value_len){
+    return key_len > ENTRY_MAX_BYTES || value_len > ENTRY_MAX_BYTES;
+}
+
+struct EntryBlock{
+    char* data;
+    uint32_t capacity;      // bytes in the chunk, the value can grow into whatever the key leaves
+    uint32_t requested;     // bytes the chunk was asked for, the slab accounts it that way
+};
+
+enum class EntryType : uint8_t{
+    String,
+    List
+};
+
 struct Entry{
-    char* key;
-    char* value;
-};
\ No newline at end of file
+    uint64_t hash;          // full hash of the key, probes and rehashing never touch key bytes
+    uint32_t key_len;       // keys are binary safe, the trailing NUL is only for printing
+    uint32_t value_len;
+    union{
+        char inline_bytes[ENTRY_INLINE_BYTES];
+        EntryBlock heap;
+    };
+    EntryType type;
+    bool packed;            // a small list kept in the value bytes themselves, see llist.h
+};
+
+static_assert(sizeof(Entry) == 64, "an entry should fill exactly one cache line");
+
+inline bool fitsInline(size_t key_len, size_t value_len){
+    return key_len + value_len + 2 <= ENTRY_INLINE_BYTES;
+}
+
+// the lengths alone decide where the bytes are, no flag needed
+inline bool entryInline(const Entry& e){
+    return fitsInline(e.key_len, e.value_len);
+}
+
+inline char* entryBytes(Entry& e){
+    return entryInline(e) ? e.inline_bytes : e.heap.data;
+}
+
+inline const char* entryBytes(const Entry& e){
+    return entryInline(e) ? e.inline_bytes : e.heap.data;
+}
+
+inline std::string_view entryKey(const Entry& e){
+    return {entryBytes(e), e.key_len};
+}
+
+// inline bytes move with the slot when the table grows, views don't outlive the next table operation
+inline std::string_view entryValue(const Entry& e){
+    return {entryBytes(e) + e.key_len + 1, e.value_len};
+}
+
+// the whole slab chunk is kept as capacity, rounding up is free headroom for later writes
+inline EntryBlock allocateEntryBlock(size_t size){
+    size_t capacity;
+    char* data = static_cast<char*>(Slabs.allocate(size, capacity));
+    return EntryBlock{data, (uint32_t) capacity, (uint32_t) size};
+}
+
+inline void freeEntryBlock(const EntryBlock& block){
+    Slabs.deallocate(block.data, block.capacity, block.requested);
+}
+
+inline void writeEntryValue(char* bytes, size_t key_len, std::string_view value){
+    std::memcpy(bytes + key_len + 1, value.data(), value.size());
+    bytes[key_len + 1 + value.size()] = '\0';
+}
+
+inline Entry makeEntry(std::string_view key, std::string_view value, uint64_t hash, EntryType type = EntryType::String){
+    Entry e{};
+    e.hash = hash;
+    e.type = type;
+    e.key_len = (uint32_t) key.size();
+    e.value_len = (uint32_t) value.size();
+    if(!entryInline(e)) e.heap = allocateEntryBlock(key.size() + value.size() + 2);
+
+    char* bytes = entryBytes(e);
+    std::memcpy(bytes, key.data(), key.size());
+    bytes[key.size()] = '\0';
+    writeEntryValue(bytes, key.size(), value);
+    return e;
+}
+
+inline void freeEntry(Entry& e){
+    if(!entryInline(e)) freeEntryBlock(e.heap);
+    e = Entry{};
+}
+
+// moves the key and the first keep_value value bytes to wherever a value_len value fits,
+// a new chunk leaves room for reserve bytes of value, the rest is up to the caller
+inline char* relocateEntry(Entry& e, size_t value_len, size_t reserve, size_t keep_value){
+    bool was_inline = entryInline(e);
+    EntryBlock old = was_inline ? EntryBlock{} : e.heap;
+    const char* from = entryBytes(e);
+    size_t keep = e.key_len + 1 + keep_value;
+
+    if(fitsInline(e.key_len, value_len)){
+        // only reached from a chunk, its pointer shares the inline bytes and was saved above
+        std::memcpy(e.inline_bytes, from, keep);
+        freeEntryBlock(old);
+        e.value_len = (uint32_t) value_len;
+        return e.inline_bytes;
+    }
+
+    EntryBlock block = allocateEntryBlock(e.key_len + std::max(value_len, reserve) + 2);
+    std::memcpy(block.data, from, keep);
+    if(!was_inline) freeEntryBlock(old);
+    e.heap = block;
+    e.value_len = (uint32_t) value_len;
+    return block.data;
+}
+
+// SET on an existing key, the key stays where it is and the value is written over the
+// old one when the slot or chunk is big enough, so overwrites don't touch the allocator
+inline void setEntryValue(Entry& e, std::string_view value){
+    size_t needed = e.key_len + value.size() + 2;
+    bool reuse = entryInline(e) ? fitsInline(e.key_len, value.size())
+                                : !fitsInline(e.key_len, value.size()) && needed <= e.heap.capacity
+                                  && needed * ENTRY_SHRINK_RATIO > e.heap.capacity;
+
+    char* bytes;
+    if(reuse){
+        bytes = entryBytes(e);
+        e.value_len = (uint32_t) value.size();
+    }else{
+        bytes = relocateEntry(e, value.size(), value.size(), 0);
+    }
+    writeEntryValue(bytes, e.key_len, value);
+}
+
+// resizes the value keeping its first bytes, a chunk is kept while the value still fits in it
+// and doubles when it runs out, so a value grown in steps is copied O(log n) times
+// value_len must not be entryTooLarge, the reserve never goes past the limit
+inline char* resizeEntryValue(Entry& e, size_t value_len){
+    size_t keep = std::min<size_t>(e.value_len, value_len);
+    bool fits = entryInline(e) ? fitsInline(e.key_len, value_len)
+                               : !fitsInline(e.key_len, value_len) && e.key_len + value_len + 2 <= e.heap.capacity;
+
+    char* bytes;
+    if(fits){
+        bytes = entryBytes(e);
+        e.value_len = (uint32_t) value_len;
+    }else{
+        bytes = relocateEntry(e, value_len, std::min(value_len * 2, ENTRY_MAX_BYTES), keep);
+    }
+    bytes[e.key_len + 1 + value_len] = '\0';
+    return bytes;
+}
+
+// APPEND
+inline void appendEntryValue(Entry& e, std::string_view suffix){
+    size_t old_len = e.value_len;
+    char* bytes = resizeEntryValue(e, old_len + suffix.size());
+    std::memcpy(bytes + e.key_len + 1 + old_len, suffix.data(), suffix.size());
+}
+
+// objects are stored by pointer in the value bytes, unaligned so copied in and out
+inline Entry makeObjectEntry(std::string_view key, const void* object, uint64_t hash, EntryType type){
+    return makeEntry(key, std::string_view((const char*) &object, sizeof(object)), hash, type);
+}
+
+template<class T>
+inline T* entryObject(const Entry& e){
+    T* object;
+    std::memcpy(&object, entryValue(e).data(), sizeof(object));
+    return object;
+}
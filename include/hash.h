@@ -0,0 +1,132 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <sys/random.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// key hashing shared by every table and the shard router
+// wyhash style: 8 and 16 byte reads folded with 64x64->128 bit multiplies, long keys are
+// consumed 48 bytes per round in three independent lanes so they hash at memory speed
+// the seed and the secrets mixed into every read are random per process, and the multiplies
+// xor their product back into the operands, a block that zeroes one factor still can't
+// cancel out the seed or the rest of the key
+
+
+// only used to spread a seed into secrets, never mixed into keys directly
+constexpr uint64_t HASH_CONSTANTS[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+struct HashSecret{
+    uint64_t seed;
+    uint64_t secret[4];
+};
+
+inline uint64_t hashRead64(const uint8_t* p){
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t hashRead32(const uint8_t* p){
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+// full product of a and b, the halves are xored back into the operands instead of replacing them
+inline void hashMultiply(uint64_t& a, uint64_t& b){
+    __uint128_t r = (__uint128_t) a * b;
+    a ^= (uint64_t) r;
+    b ^= (uint64_t) (r >> 64);
+}
+
+inline uint64_t hashMix(uint64_t a, uint64_t b){
+    hashMultiply(a, b);
+    return a ^ b;
+}
+
+// splitmix64 rounds, every secret is odd so no multiply by it can lose the low bit
+inline HashSecret makeHashSecret(uint64_t seed){
+    HashSecret s;
+    s.seed = seed;
+    uint64_t state = seed;
+    for(int i = 0; i < 4; ++i){
+        state += 0x9e3779b97f4a7c15ull;
+        uint64_t z = state ^ HASH_CONSTANTS[i];
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        s.secret[i] = (z ^ (z >> 31)) | 1;
+    }
+    return s;
+}
+
+// set once by seedHash before any shard thread starts, only read afterwards
+inline HashSecret KeyHashSecret = makeHashSecret(0);
+
+inline uint64_t hashBytes(const void* key, size_t len, const HashSecret& s){
+    const uint8_t* p = static_cast<const uint8_t*>(key);
+    uint64_t seed = s.seed ^ hashMix(s.seed ^ s.secret[0], s.secret[1]);
+
+    uint64_t a, b;
+    if(len <= 16){
+        if(len >= 4){
+            // two overlapping reads from each end cover every byte of 4..16
+            size_t shift = (len >> 3) << 2;
+            a = (hashRead32(p) << 32) | hashRead32(p + shift);
+            b = (hashRead32(p + len - 4) << 32) | hashRead32(p + len - 4 - shift);
+        }else if(len > 0){
+            a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        }else{
+            a = b = 0;
+        }
+    }else{
+        size_t left = len;
+        if(left > 48){
+            uint64_t lane1 = seed, lane2 = seed;
+            do{
+                seed = hashMix(hashRead64(p) ^ s.secret[1], hashRead64(p + 8) ^ seed);
+                lane1 = hashMix(hashRead64(p + 16) ^ s.secret[2], hashRead64(p + 24) ^ lane1);
+                lane2 = hashMix(hashRead64(p + 32) ^ s.secret[3], hashRead64(p + 40) ^ lane2);
+                p += 48;
+                left -= 48;
+            }while(left > 48);
+            seed ^= lane1 ^ lane2;
+        }
+        while(left > 16){
+            seed = hashMix(hashRead64(p) ^ s.secret[1], hashRead64(p + 8) ^ seed);
+            p += 16;
+            left -= 16;
+        }
+        // the last 16 bytes, overlapping the previous round when the key isn't a multiple
+        a = hashRead64(p + left - 16);
+        b = hashRead64(p + left - 8);
+    }
+
+    a ^= s.secret[1];
+    b ^= seed;
+    hashMultiply(a, b);
+    return hashMix(a ^ s.secret[0] ^ len, b ^ s.secret[1]);
+}
+
+inline uint64_t hashKey(std::string_view key){
+    return hashBytes(key.data(), key.size(), KeyHashSecret);
+}
+
+// keys and shards depend on the seed, it has to be picked before the first table is used
+inline void seedHash(){
+    uint64_t seed;
+    if(getrandom(&seed, sizeof(seed), 0) != sizeof(seed)){
+        // no entropy source, still different for every run
+        seed = hashMix(std::chrono::steady_clock::now().time_since_epoch().count() ^ HASH_CONSTANTS[2],
+                       (uint64_t) getpid() ^ HASH_CONSTANTS[3]);
+    }
+    KeyHashSecret = makeHashSecret(seed);
+}
+
+#endif
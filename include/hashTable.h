@@ -2,21 +2,22 @@
 #define HASHTABLE_H 
 
 #include <stddef.h>
+#include <stdint.h>
 
-struct Entry;
-struct NodeHeader;
+// starting slot count of every shard's keyspace, set from the command line before the
+// first shard touches its table, a table sized for its keys up front never resizes
+inline size_t KeyspaceCapacity = 1024;
 
-struct ListHashTable{
-    NodeHeader* nodeHeaders;
-    size_t size;
-    size_t capacity;
-};
+// largest starting table, 2^30 slots of 64 bytes are already 64 GiB per shard
+constexpr size_t MAX_TABLE_CAPACITY = (size_t) 1 << 30;
 
-struct StringHashTable{
-    Entry* entries;
-    size_t size;
-    size_t capacity;
+// the table indexes with a mask, capacities are powers of two of at least one 16 slot group
+// requests past MAX_TABLE_CAPACITY get that, the doubling never overflows
+inline size_t tableCapacity(size_t requested){
+    size_t capacity = 16;
+    while(capacity < requested && capacity < MAX_TABLE_CAPACITY) capacity <<= 1;
+    return capacity;
+}
 
-};
 
 #endif
\ No newline at end of file
@@ -0,0 +1,227 @@
+#ifndef IOBUFFER_H
+#define IOBUFFER_H
+
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// connection buffers are built from fixed size segments with read/write cursors
+// consuming bytes only moves a cursor, segments go back to a per-thread pool and
+// get reused by the next connection instead of returning to malloc
+
+constexpr size_t SEGMENT_SIZE = 16 * 1024;
+constexpr size_t MAX_POOLED_SEGMENTS = 4096;
+
+
+struct BufferSegment{
+    char* data;
+    size_t capacity;
+    size_t start;           // first unconsumed byte
+    size_t end;             // first free byte
+    BufferSegment* next;
+};
+
+struct BufferPool{
+    BufferSegment* free_list = nullptr;
+    size_t free_count = 0;
+
+    ~BufferPool(){
+        while(free_list != nullptr){
+            BufferSegment* next = free_list->next;
+            delete[] free_list->data;
+            delete free_list;
+            free_list = next;
+        }
+    }
+};
+
+// one pool per reactor thread, no locking needed
+thread_local BufferPool SegmentPool;
+
+
+BufferSegment* acquireSegment(size_t min_capacity = SEGMENT_SIZE){
+    BufferSegment* segment;
+
+    if(min_capacity <= SEGMENT_SIZE && SegmentPool.free_list != nullptr){
+        segment = SegmentPool.free_list;
+        SegmentPool.free_list = segment->next;
+        SegmentPool.free_count--;
+    }else{
+        size_t capacity = min_capacity <= SEGMENT_SIZE ? SEGMENT_SIZE : min_capacity;
+        segment = new BufferSegment;
+        segment->data = new char[capacity];
+        segment->capacity = capacity;
+    }
+
+    segment->start = 0;
+    segment->end = 0;
+    segment->next = nullptr;
+    return segment;
+}
+
+void releaseSegment(BufferSegment* segment){
+    // oversized segments only exist for unusually large commands, don't keep them around
+    if(segment->capacity != SEGMENT_SIZE || SegmentPool.free_count >= MAX_POOLED_SEGMENTS){
+        delete[] segment->data;
+        delete segment;
+        return;
+    }
+
+    segment->next = SegmentPool.free_list;
+    SegmentPool.free_list = segment;
+    SegmentPool.free_count++;
+}
+
+
+// inbound bytes, kept contiguous so a command can always be parsed in place
+struct ReadBuffer{
+    BufferSegment* segment = nullptr;
+};
+
+const char* readData(const ReadBuffer& buffer){
+    return buffer.segment ? buffer.segment->data + buffer.segment->start : nullptr;
+}
+
+size_t readSize(const ReadBuffer& buffer){
+    return buffer.segment ? buffer.segment->end - buffer.segment->start : 0;
+}
+
+// returns where the next read() should land and how much room there is
+char* readSpace(ReadBuffer& buffer, size_t& space){
+    if(buffer.segment == nullptr) buffer.segment = acquireSegment();
+
+    BufferSegment* segment = buffer.segment;
+    if(segment->capacity - segment->end < SEGMENT_SIZE / 4){
+        size_t unread = segment->end - segment->start;
+
+        if(segment->start > 0 && unread < segment->capacity / 2){
+            // only the trailing partial command is moved, everything before it was consumed
+            std::memmove(segment->data, segment->data + segment->start, unread);
+        }else{
+            // a single command is larger than the segment, grow it
+            BufferSegment* larger = acquireSegment(segment->capacity * 2);
+            std::memcpy(larger->data, segment->data + segment->start, unread);
+            releaseSegment(segment);
+            buffer.segment = segment = larger;
+        }
+        segment->start = 0;
+        segment->end = unread;
+    }
+
+    space = segment->capacity - segment->end;
+    return segment->data + segment->end;
+}
+
+void commitRead(ReadBuffer& buffer, size_t bytes){
+    buffer.segment->end += bytes;
+}
+
+void appendRead(ReadBuffer& buffer, const char* data, size_t len){
+    while(len > 0){
+        size_t space;
+        char* dst = readSpace(buffer, space);
+        size_t n = len < space ? len : space;
+        std::memcpy(dst, data, n);
+        commitRead(buffer, n);
+        data += n;
+        len -= n;
+    }
+}
+
+void releaseRead(ReadBuffer& buffer){
+    if(buffer.segment != nullptr) releaseSegment(buffer.segment);
+    buffer.segment = nullptr;
+}
+
+void consumeRead(ReadBuffer& buffer, size_t bytes){
+    buffer.segment->start += bytes;
+    // an idle connection holds no buffer at all
+    if(buffer.segment->start == buffer.segment->end) releaseRead(buffer);
+}
+
+
+// outbound bytes, a chain of segments written out with a single writev
+struct WriteChain{
+    BufferSegment* head = nullptr;
+    BufferSegment* tail = nullptr;
+    size_t bytes = 0;
+};
+
+void appendChain(WriteChain& chain, const char* data, size_t len){
+    chain.bytes += len;
+    while(len > 0){
+        if(chain.tail == nullptr || chain.tail->end == chain.tail->capacity){
+            BufferSegment* segment = acquireSegment();
+            if(chain.tail == nullptr){
+                chain.head = segment;
+            }else{
+                chain.tail->next = segment;
+            }
+            chain.tail = segment;
+        }
+
+        size_t space = chain.tail->capacity - chain.tail->end;
+        size_t n = len < space ? len : space;
+        std::memcpy(chain.tail->data + chain.tail->end, data, n);
+        chain.tail->end += n;
+        data += n;
+        len -= n;
+    }
+}
+
+size_t fillIovecs(const WriteChain& chain, iovec* iov, size_t max){
+    size_t count = 0;
+    for(BufferSegment* segment = chain.head; segment != nullptr && count < max; segment = segment->next){
+        iov[count].iov_base = segment->data + segment->start;
+        iov[count].iov_len = segment->end - segment->start;
+        ++count;
+    }
+    return count;
+}
+
+// drops written bytes, fully drained segments go back to the pool
+void consumeChain(WriteChain& chain, size_t bytes){
+    chain.bytes -= bytes;
+    while(bytes > 0){
+        BufferSegment* segment = chain.head;
+        size_t left = segment->end - segment->start;
+        if(bytes < left){
+            segment->start += bytes;
+            return;
+        }
+
+        bytes -= left;
+        chain.head = segment->next;
+        if(chain.head == nullptr) chain.tail = nullptr;
+        releaseSegment(segment);
+    }
+}
+
+size_t chainSegments(const WriteChain& chain){
+    size_t count = 0;
+    for(BufferSegment* segment = chain.head; segment != nullptr; segment = segment->next) ++count;
+    return count;
+}
+
+void releaseChain(WriteChain& chain){
+    while(chain.head != nullptr){
+        BufferSegment* next = chain.head->next;
+        releaseSegment(chain.head);
+        chain.head = next;
+    }
+    chain.tail = nullptr;
+    chain.bytes = 0;
+}
+
+// copies the chain out, its segments stay in this thread's pool
+void drainChain(WriteChain& chain, std::string& out){
+    out.clear();
+    out.reserve(chain.bytes);
+    for(BufferSegment* segment = chain.head; segment != nullptr; segment = segment->next){
+        out.append(segment->data + segment->start, segment->end - segment->start);
+    }
+    releaseChain(chain);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef IOTHREADS_H
+#define IOTHREADS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// helper threads that run one phase of socket work in lock step with the event loop
+// the caller hands out a job, takes share 0 itself and returns once every share is done,
+// so nothing else runs while the helpers touch client state
+
+
+class IoThreadPool{
+
+    public:
+
+    // helpers is the number of extra threads, the calling thread always takes part
+    explicit IoThreadPool(size_t helpers = 0){
+        for(size_t i = 1; i <= helpers; ++i){
+            m_threads.emplace_back([this, i](){ worker(i); });
+        }
+    }
+
+    ~IoThreadPool(){
+        m_stopping = true;
+        m_generation.fetch_add(1);
+        m_generation.notify_all();
+        for(auto& t: m_threads) t.join();
+    }
+
+    size_t size() const{
+        return m_threads.size() + 1;
+    }
+
+    // runs job(share) for every share in [0, size()), share 0 on the caller
+    void run(const std::function<void(size_t)>& job){
+        if(m_threads.empty()){
+            job(0);
+            return;
+        }
+
+        m_job = &job;
+        m_running = m_threads.size();
+        m_generation.fetch_add(1);
+        m_generation.notify_all();
+
+        job(0);
+
+        size_t left;
+        while((left = m_running.load()) != 0) m_running.wait(left);
+        m_job = nullptr;
+    }
+
+    private:
+
+    std::vector<std::thread> m_threads;
+    const std::function<void(size_t)>* m_job = nullptr;
+    std::atomic<uint64_t> m_generation{0};
+    std::atomic<size_t> m_running{0};
+    std::atomic<bool> m_stopping{false};
+
+    void worker(size_t share){
+        uint64_t seen = 0;
+        while(true){
+            // futex backed, idle helpers sleep instead of spinning
+            m_generation.wait(seen);
+            seen = m_generation.load();
+            if(m_stopping) return;
+
+            (*m_job)(share);
+            if(m_running.fetch_sub(1) == 1) m_running.notify_one();
+        }
+    }
+};
+
+#endif
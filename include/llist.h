@@ -1,526 +1,874 @@
 #include <iostream>
 #include <cstdint>
 #include "hashTable.h"
+#include "slab.h"
+#include "hash.h"
+#include <algorithm>
+#include <charconv>
 #include <cstring>
 #include <sstream>
+#include <string_view>
+#include <vector>
 
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 #include "rapidjson/reader.h"
 
-struct Node{
-    Node* after;
-    Node * before;
-    char* value;
+// lists are keyspace entries like strings, see dict.h, a small list is packed into the entry's
+// value bytes, a larger one is a List the entry holds a pointer to
+// a list that loses its last element is removed from the keyspace
+
+// quicklist: elements are packed into chunks, a doubly linked chain of slab allocated buffers
+// an element is its length as a varint, the bytes, then the size of both again, stored back
+// to front so a chunk can be read from either end
+// the data sits between begin and end, a chunk started by a push to the front fills its
+// buffer from the back, so pushes at both ends only write bytes until the chunk is full
+constexpr size_t LIST_CHUNK_BYTES = 8192;   // chunks double up to this, then another one is linked
+
+struct ListChunk{
+    ListChunk* after;
+    ListChunk* before;
+    uint32_t count;         // elements
+    uint32_t begin;
+    uint32_t end;
+    uint32_t capacity;      // data bytes following the header
+    uint32_t requested;     // bytes asked of the slab, header included, for its accounting
 };
 
-struct NodeHeader{
-    Node* first;
-    Node* last;
+// lists that are mostly read and deleted by index switch to a ring buffer of value handles
+// instead, LGET is one array lookup and LDEL moves the shorter side of the ring
+// the encoding follows the list's size and how it is accessed, see noteIndexAccess
+enum class ListEncoding : uint8_t{
+    Chunks,
+    Ring
+};
+
+struct List{
+    ListChunk* first;       // chunk encoding
+    ListChunk* last;
+    char** ring;            // ring encoding, power of two capacity, element i at (ring_head + i) & mask
+    size_t ring_head;
+    size_t ring_capacity;
     size_t size;
-    char* key;
+    size_t since_convert;   // operations since the encoding last changed
+    uint32_t index_score;   // recent indexed access against operations at the ends
+    ListEncoding encoding;
 };
 
+constexpr size_t LIST_RING_MIN_SIZE = 256;      // shorter lists are walked quickly enough
+constexpr size_t LIST_RING_MIN_CAPACITY = 16;
+constexpr uint32_t LIST_INDEX_WEIGHT = 16;      // an indexed access outweighs this many end operations
+constexpr uint32_t LIST_RING_SCORE = 256;       // score that moves a long list to the ring
+constexpr uint32_t LIST_RING_SCORE_MAX = 4096;
+
+constexpr size_t LIST_CHUNK_DATA = LIST_CHUNK_BYTES - sizeof(ListChunk);
 
-NodeHeader* initializeNodeHeaders(size_t capacity) {
-    NodeHeader* headers = new NodeHeader[capacity];
-    for(size_t i = 0; i < capacity; ++i) {
-        headers[i].first = nullptr;
-        headers[i].last = nullptr;
-        headers[i].size = 0;
-        headers[i].key = nullptr;
+inline size_t varintSize(size_t value){
+    size_t size = 1;
+    while(value >= 0x80){
+        value >>= 7;
+        ++size;
     }
-    return headers;
+    return size;
 }
 
-ListHashTable ListTable = {initializeNodeHeaders(1024), 0, 1024};
+// 7 bits per byte, low bits first, the high bit is set on all but the last byte
+inline char* writeVarint(char* p, size_t value){
+    while(value >= 0x80){
+        *p++ = (char) (value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (char) value;
+    return p;
+}
 
+inline size_t readVarint(const char*& p){
+    size_t value = 0;
+    uint8_t byte;
+    for(int shift = 0; ; shift += 7){
+        byte = (uint8_t) *p++;
+        value |= (size_t) (byte & 0x7F) << shift;
+        if(!(byte & 0x80)) return value;
+    }
+}
 
-std::uint64_t generateListHash(const char* key, size_t len)
-{
-    uint64_t hash = 14695981039346656037ull;
-    for(size_t i = 0; i < len; ++i){
-        hash^= static_cast<uint64_t>(key[i]);
-        hash*= 1099511628211ull;
+// the bytes of writeVarint reversed, read starting from the byte before end
+inline char* writeBackVarint(char* p, size_t value){
+    char* end = writeVarint(p, value);
+    std::reverse(p, end);
+    return end;
+}
+
+inline size_t readBackVarint(const char*& end){
+    size_t value = 0;
+    uint8_t byte;
+    for(int shift = 0; ; shift += 7){
+        byte = (uint8_t) *--end;
+        value |= (size_t) (byte & 0x7F) << shift;
+        if(!(byte & 0x80)) return value;
     }
+}
 
-    return hash;
+inline size_t listElementSize(size_t len){
+    size_t body = varintSize(len) + len;
+    return body + varintSize(body);
 }
 
-size_t getListIndex(std::string key)
-{
-    uint64_t hash = generateListHash(key.c_str(), key.length());
-    
-    size_t index = hash % ListTable.capacity;
-    
-    
-    size_t attempts = 0;
-    while(ListTable.nodeHeaders[index].key != nullptr && std::strcmp(ListTable.nodeHeaders[index].key, key.c_str()) != 0){
-        index = (index + 1) % ListTable.capacity;
-        ++attempts;
-        
-        if(attempts >= ListTable.capacity){
-            return ListTable.capacity;
-        }
-    }  
+inline void writeListElement(char* p, std::string_view value){
+    char* bytes = writeVarint(p, value.size());
+    std::memcpy(bytes, value.data(), value.size());
+    writeBackVarint(bytes + value.size(), bytes + value.size() - p);
+}
 
-    return index;
+// the element starting at p, returns where the next one starts
+inline const char* readListElement(const char* p, std::string_view& value){
+    const char* bytes = p;
+    size_t len = readVarint(bytes);
+    value = std::string_view(bytes, len);
+    size_t body = bytes - p + len;
+    return p + body + varintSize(body);
 }
 
-void resizeListTable(size_t new_capacity)
-{
-    ListHashTable oldTable = ListTable;
-    size_t oldCapacity = ListTable.capacity;
+// start of the element that ends at p
+inline const char* listElementBefore(const char* p){
+    size_t body = readBackVarint(p);
+    return p - body;
+}
 
-    ListTable.nodeHeaders = initializeNodeHeaders(new_capacity);
-    ListTable.capacity = new_capacity;
-    ListTable.size = 0;
+inline char* chunkData(ListChunk* chunk){
+    return reinterpret_cast<char*>(chunk + 1);
+}
+
+inline const char* chunkData(const ListChunk* chunk){
+    return reinterpret_cast<const char*>(chunk + 1);
+}
+
+// chunks come from the shard's slab allocator like keys and values, the whole slab chunk is used
+inline ListChunk* allocateListChunk(size_t data_bytes){
+    size_t requested = sizeof(ListChunk) + data_bytes, bytes;
+    ListChunk* chunk = static_cast<ListChunk*>(Slabs.allocate(requested, bytes));
+    *chunk = ListChunk{nullptr, nullptr, 0, 0, 0, (uint32_t) (bytes - sizeof(ListChunk)), (uint32_t) requested};
+    return chunk;
+}
 
-    for (size_t i = 0; i < oldCapacity; ++i) {
-        if (oldTable.nodeHeaders[i].key != nullptr) {
+inline void freeListChunk(ListChunk* chunk){
+    Slabs.deallocate(chunk, sizeof(ListChunk) + chunk->capacity, chunk->requested);
+}
 
-            // Rehash using old key
-            uint64_t hash = generateListHash(oldTable.nodeHeaders[i].key, std::strlen(oldTable.nodeHeaders[i].key));
-            size_t index = hash % new_capacity;
+// puts replacement where chunk was in the chain
+void replaceListChunk(List* list, ListChunk* chunk, ListChunk* replacement){
+    replacement->before = chunk->before;
+    replacement->after = chunk->after;
+    if(chunk->before == nullptr) list->first = replacement;
+    else chunk->before->after = replacement;
+    if(chunk->after == nullptr) list->last = replacement;
+    else chunk->after->before = replacement;
+}
 
-            size_t attempts = 0;
-            while (ListTable.nodeHeaders[index].key != nullptr && 
-                std::strcmp(ListTable.nodeHeaders[index].key, oldTable.nodeHeaders[i].key) != 0) {
-                index = (index + 1) % new_capacity;
-                ++attempts;
-                if (attempts >= new_capacity) break;  
-            }
+void unlinkListChunk(List* list, ListChunk* chunk){
+    if(chunk->before == nullptr) list->first = chunk->after;
+    else chunk->before->after = chunk->after;
+    if(chunk->after == nullptr) list->last = chunk->before;
+    else chunk->after->before = chunk->before;
+    freeListChunk(chunk);
+}
 
-            ListTable.nodeHeaders[index] = oldTable.nodeHeaders[i];
+// the chunk at one end of the list with room for needed more bytes on that side
+// the end chunk is compacted or doubled while it is below LIST_CHUNK_BYTES, otherwise a new
+// one is linked, small lists start with a small chunk, long ones get full sized chunks
+ListChunk* listEndChunk(List* list, size_t needed, bool back){
+    ListChunk* chunk = back ? list->last : list->first;
+    if(chunk != nullptr && (back ? chunk->capacity - chunk->end : chunk->begin) >= needed) return chunk;
+
+    size_t used = chunk == nullptr ? 0 : chunk->end - chunk->begin;
+    if(chunk == nullptr || used + needed > LIST_CHUNK_DATA){
+        ListChunk* added = allocateListChunk(chunk == nullptr ? needed : std::max(needed, LIST_CHUNK_DATA));
+        if(!back) added->begin = added->end = added->capacity;
+        added->before = back ? chunk : nullptr;
+        added->after = back ? nullptr : chunk;
+        if(chunk == nullptr) list->first = list->last = added;
+        else if(back) list->last = chunk->after = added;
+        else list->first = chunk->before = added;
+        return added;
+    }
 
-            oldTable.nodeHeaders[i].key = nullptr;
-            oldTable.nodeHeaders[i].first = nullptr;
-            oldTable.nodeHeaders[i].last = nullptr;
-            oldTable.nodeHeaders[i].size = 0;
+    ListChunk* target = chunk;
+    if(used + needed > chunk->capacity){
+        target = allocateListChunk(std::min(std::max((size_t) chunk->capacity * 2, used + needed), LIST_CHUNK_DATA));
+        target->count = chunk->count;
+    }
+    size_t begin = back ? 0 : target->capacity - used;
+    std::memmove(chunkData(target) + begin, chunkData(chunk) + chunk->begin, used);
+    target->begin = (uint32_t) begin;
+    target->end = (uint32_t) (begin + used);
+
+    if(target != chunk){
+        replaceListChunk(list, chunk, target);
+        freeListChunk(chunk);
+    }
+    return target;
+}
 
-            ListTable.size++;
+// chunk holding element index and the offset of that element within the chunk data
+// whole chunks are skipped by their counts from whichever end of the list is closer
+ListChunk* listElementAt(List* list, size_t index, size_t& offset){
+    ListChunk* chunk;
+    if(index < list->size / 2){
+        chunk = list->first;
+        while(index >= chunk->count){
+            index -= chunk->count;
+            chunk = chunk->after;
+        }
+    }else{
+        size_t from_end = list->size - 1 - index;
+        chunk = list->last;
+        while(from_end >= chunk->count){
+            from_end -= chunk->count;
+            chunk = chunk->before;
         }
+        index = chunk->count - 1 - from_end;
     }
-    
-    // Clean up old table
-    delete[] oldTable.nodeHeaders;
+
+    const char* data = chunkData(chunk);
+    const char* p;
+    std::string_view value;
+    if(index < chunk->count / 2){
+        p = data + chunk->begin;
+        for(size_t i = 0; i < index; ++i) p = readListElement(p, value);
+    }else{
+        p = data + chunk->end;
+        for(size_t i = chunk->count; i > index; --i) p = listElementBefore(p);
+    }
+    offset = p - data;
+    return chunk;
 }
 
+// removes the element at offset, the shorter side of the chunk is moved over the gap
+// an emptied chunk is unlinked
+void removeChunkElement(List* list, ListChunk* chunk, size_t offset){
+    char* data = chunkData(chunk);
+    std::string_view value;
+    size_t size = readListElement(data + offset, value) - (data + offset);
+
+    if(offset - chunk->begin < chunk->end - offset - size){
+        std::memmove(data + chunk->begin + size, data + chunk->begin, offset - chunk->begin);
+        chunk->begin += size;
+    }else{
+        std::memmove(data + offset, data + offset + size, chunk->end - offset - size);
+        chunk->end -= size;
+    }
 
+    if(--chunk->count == 0) unlinkListChunk(list, chunk);
+    list->size--;
+}
 
+void chunkPushBack(List* list, std::string_view value){
+    size_t size = listElementSize(value.size());
+    ListChunk* chunk = listEndChunk(list, size, true);
+    writeListElement(chunkData(chunk) + chunk->end, value);
+    chunk->end += size;
+    chunk->count++;
+    list->size++;
+}
 
-void pushBackList(std::string key, std::string value)
-{
-    if(ListTable.size >= (ListTable.capacity * 0.75)) 
-        resizeListTable(ListTable.size*2);
-    
-    size_t index = getListIndex(key);
-    if(index >= ListTable.capacity){    
-        std::cout << "Out of Bounds List Push\n"; 
-        return;
-    } 
-    
-    NodeHeader* header = &ListTable.nodeHeaders[index];
-    if (header->first == nullptr){
-        
-        // index = getListIndex(key);
-        // header = &ListTable.nodeHeaders[index];
-        
-        ListTable.size++;
-
-        header->first = new Node;
-        header->last = header->first;
-        
-        header->first->after = nullptr;
-        header->first->before = nullptr;
-        
-        header->key = new char[key.size()+1];
-        std::strcpy(header->key, key.c_str());
-        
-        header->first->value = new char[value.size()+1];
-        std::strcpy(header->first->value, value.c_str());
-    }  
-    else{
-        Node *newNode = new Node;
-        newNode->after = nullptr;
-        newNode->before = header->last;
-        
-        header->last->after = newNode;
-        header->last = newNode;
-        newNode->value = new char[value.size()+1];
-        std::strcpy(newNode->value, value.c_str());
-    }
-    header->size++;
+void chunkPushFront(List* list, std::string_view value){
+    size_t size = listElementSize(value.size());
+    ListChunk* chunk = listEndChunk(list, size, false);
+    chunk->begin -= size;
+    writeListElement(chunkData(chunk) + chunk->begin, value);
+    chunk->count++;
+    list->size++;
 }
 
-std::string popBackList(std::string key)
-{
-    size_t index = getListIndex(key);
-    if(index >= ListTable.capacity){    
-        std::cout << "Out of Bounds List Push\n"; 
-        return "\n";
-    } 
-
-    NodeHeader* header = &ListTable.nodeHeaders[index];
-    
-    if(header->key == nullptr) return "";
-    
-    Node* currentNode = header->last;
-    
-    if(currentNode == nullptr) return ""; // list is broken if current node is nullptr; add something to fix the list
-    
-    
-    if(header->last == header->first){
-        header->last = nullptr;
-        header->first = nullptr;
-        std::string value = currentNode->value;
-        delete[] currentNode->value;
-        delete currentNode;
-        
-        header->size--;
-        return value;
+void freeChunks(List* list){
+    ListChunk* chunk = list->first;
+    while(chunk != nullptr){
+        ListChunk* next = chunk->after;
+        freeListChunk(chunk);
+        chunk = next;
     }
-    
-    currentNode->before->after = nullptr;
-    header->last = currentNode->before;
-    
-    std::string value = currentNode->value;
-    delete[] currentNode->value;
-    delete currentNode;
-    
-    header->size--;
-    return value;
-}
-
-void pushFrontList(std::string key, std::string value)
-{
-    size_t index = getListIndex(key);
-    
-    if(index >= ListTable.capacity){    
-        std::cout << "Out of Bounds List Push\n"; 
-        return;
-    } 
-    
-    NodeHeader* header = &ListTable.nodeHeaders[index];
-    if (header->first == nullptr){
-        
-        ListTable.size++;
-        if(ListTable.size >= (ListTable.capacity * 0.75)) resizeListTable(ListTable.size*2);
-
-        header->first = new Node;
-        header->last = header->first;
-        
-        header->first->after = nullptr;
-        header->first->before = nullptr;
-        
-        header->key = new char[key.size()+1];
-        std::strcpy(header->key, key.c_str());
-        
-        header->first->value = new char[value.size()+1];
-        std::strcpy(header->first->value, value.c_str());
-    }  
-    else{
-        Node *newNode = new Node;
-        newNode->before = nullptr;
-        newNode->after = header->first;
-        
-        header->first->before = newNode;
-        header->first = newNode;
-        newNode->value = new char[value.size()+1];
-        std::strcpy(newNode->value, value.c_str());
-    }
-    header->size++;
+    list->first = list->last = nullptr;
 }
 
 
-std::string popFrontList(std::string key)
-{
+// a ring element is a slab chunk holding the value's length as a varint and the bytes
+inline char* makeListValue(std::string_view value){
+    size_t size = varintSize(value.size()) + value.size();
+    char* handle = static_cast<char*>(Slabs.allocate(size));
+    std::memcpy(writeVarint(handle, value.size()), value.data(), value.size());
+    return handle;
+}
 
-    size_t index = getListIndex(key);
-    if(index >= ListTable.capacity){    
-        std::cout << "Out of Bounds List Push\n"; 
-        return "\n";
-    } 
-
-    NodeHeader* header = &ListTable.nodeHeaders[index];
-    
-    if(header->key == nullptr) return "";
-    
-    Node* currentNode = header->first;
-    
-    if(currentNode == nullptr) return ""; // list is broken if current node is nullptr; add something to fix the list
-    
-    
-    if(header->last == header->first){
-        header->last = nullptr;
-        header->first = nullptr;
-        std::string value = currentNode->value;
-        delete[] currentNode->value;
-        delete currentNode;
-        
-        header->size--;
-        return value;
-    }
-    
-    currentNode->after->before = nullptr;
-    header->first = currentNode->after;
-    
-    std::string value = currentNode->value;
-    delete[] currentNode->value;
-    delete currentNode;
-    
-    header->size--;
-    return value;
+inline std::string_view listValue(const char* handle){
+    size_t len = readVarint(handle);
+    return std::string_view(handle, len);
 }
 
+inline void freeListValue(char* handle){
+    std::string_view value = listValue(handle);
+    Slabs.deallocate(handle, value.data() + value.size() - handle);
+}
 
-std::string getList(std::string key)
-{
-    
-    size_t index = getListIndex(key);
-    
-    
-    if(index >= ListTable.capacity){    
-        std::cout << "Out of Bounds List Get\n"; 
-        return "\n";
-    } 
-    
-
-    std::string result = "";
-    
-    NodeHeader* header = &ListTable.nodeHeaders[index];
-    
-    
-    
-    if(header->key == nullptr) return "-1\n";
-    
-    Node* currentNode = header->first;
-    
-    
-    if(currentNode == nullptr) return "-1\n";
-    
-    while(currentNode != nullptr){
-        
-        if(currentNode->value){
-            
-            result.append(currentNode->value);
-            result.append(" ");
-        }
-        currentNode = currentNode->after;
-    }
-    result.append("\n");
-    
-    return result;
-    
+inline char*& ringSlot(List* list, size_t index){
+    return list->ring[(list->ring_head + index) & (list->ring_capacity - 1)];
 }
 
-std::string getListR(std::string key, int list_index)
-{
-    size_t index = getListIndex(key);
+// copies the handles in order to the start of a new array
+void resizeRing(List* list, size_t capacity){
+    char** ring = static_cast<char**>(Slabs.allocate(capacity * sizeof(char*)));
+    for(size_t i = 0; i < list->size; ++i) ring[i] = ringSlot(list, i);
 
-    if(ListTable.nodeHeaders[index].key == nullptr) return "Invalid Key\n";
+    if(list->ring != nullptr) Slabs.deallocate(list->ring, list->ring_capacity * sizeof(char*));
+    list->ring = ring;
+    list->ring_head = 0;
+    list->ring_capacity = capacity;
+}
 
-    NodeHeader* header = &ListTable.nodeHeaders[index];
+void ringPushBack(List* list, std::string_view value){
+    if(list->size == list->ring_capacity) resizeRing(list, list->ring_capacity * 2);
+    list->size++;
+    ringSlot(list, list->size - 1) = makeListValue(value);
+}
 
-    if(header->size <= list_index) return "Index Out of Bounds\n";
+void ringPushFront(List* list, std::string_view value){
+    if(list->size == list->ring_capacity) resizeRing(list, list->ring_capacity * 2);
+    list->ring_head = (list->ring_head - 1) & (list->ring_capacity - 1);
+    list->size++;
+    ringSlot(list, 0) = makeListValue(value);
+}
 
-    Node* currentNode; 
-    if(list_index > (header->size/2)) { // If index if closer to last then search from last otherwise search from start
+// the handles on the shorter side of index move one step over it, the ring halves at a quarter full
+void removeRingElement(List* list, size_t index){
+    freeListValue(ringSlot(list, index));
 
-        currentNode = header->last;
-        
-        int i = header->size-1;
-        
-        while(i > list_index){
-            currentNode = currentNode->before;
-            --i;
+    if(index < list->size / 2){
+        for(size_t i = index; i > 0; --i) ringSlot(list, i) = ringSlot(list, i - 1);
+        list->ring_head = (list->ring_head + 1) & (list->ring_capacity - 1);
+    }else{
+        for(size_t i = index; i + 1 < list->size; ++i) ringSlot(list, i) = ringSlot(list, i + 1);
+    }
+    list->size--;
+
+    if(list->ring_capacity > LIST_RING_MIN_CAPACITY && list->size < list->ring_capacity / 4){
+        resizeRing(list, list->ring_capacity / 2);
+    }
+}
+
+void freeRing(List* list){
+    for(size_t i = 0; i < list->size; ++i) freeListValue(ringSlot(list, i));
+    Slabs.deallocate(list->ring, list->ring_capacity * sizeof(char*));
+    list->ring = nullptr;
+    list->ring_head = list->ring_capacity = 0;
+}
+
+
+// calls f with every element in order
+template<class F>
+void forEachListElement(const List* list, F&& f){
+    if(list->encoding == ListEncoding::Ring){
+        for(size_t i = 0; i < list->size; ++i){
+            f(listValue(list->ring[(list->ring_head + i) & (list->ring_capacity - 1)]));
         }
+        return;
     }
-    else{
-                
-        currentNode = header->first;
-        
-        int i = 0;
-
-        while(i < list_index){
-            currentNode = currentNode->after;
-            ++i;
+
+    std::string_view value;
+    for(const ListChunk* chunk = list->first; chunk != nullptr; chunk = chunk->after){
+        const char* p = chunkData(chunk) + chunk->begin;
+        const char* end = chunkData(chunk) + chunk->end;
+        while(p < end){
+            p = readListElement(p, value);
+            f(value);
         }
     }
+}
 
-    std::string result = currentNode->value;
-    result.append("\n");
-    return result;
+void convertToRing(List* list){
+    size_t capacity = LIST_RING_MIN_CAPACITY;
+    while(capacity < list->size) capacity *= 2;
+
+    char** ring = static_cast<char**>(Slabs.allocate(capacity * sizeof(char*)));
+    size_t i = 0;
+    forEachListElement(list, [&](std::string_view value){
+        ring[i++] = makeListValue(value);
+    });
+
+    freeChunks(list);
+    list->ring = ring;
+    list->ring_head = 0;
+    list->ring_capacity = capacity;
+    list->encoding = ListEncoding::Ring;
+    list->since_convert = 0;
 }
 
-bool delList(std::string key)
-{
-    size_t index = getListIndex(key);
+void convertToChunks(List* list){
+    List chunks{};
+    for(size_t i = 0; i < list->size; ++i) chunkPushBack(&chunks, listValue(ringSlot(list, i)));
 
-    if(index >= ListTable.capacity){    
-        std::cout << "Out of Bounds List Push\n"; 
-        return false;
-    }
+    freeRing(list);
+    list->first = chunks.first;
+    list->last = chunks.last;
+    list->encoding = ListEncoding::Chunks;
+    list->since_convert = 0;
+}
 
-    NodeHeader* header = &ListTable.nodeHeaders[index];
-    
-    if(header->key == nullptr || strcmp(header->key, key.c_str()) != 0) return false;
+// a conversion copies the whole list, it only happens once as many operations as the list has
+// elements have run since the last one, so a pattern that keeps tipping the score back and
+// forth still pays O(1) per operation for the conversions
+inline bool conversionPaidFor(const List* list){
+    return list->since_convert >= list->size;
+}
 
-    // Delete all nodes 
-    Node* currentNode = header->first;
-    while(currentNode != nullptr) {
-        Node* nextNode = currentNode->after;
+// every indexed access raises the score, every push or pop lowers it by one
+// a long chunked list whose score gets high enough moves to the ring, a ring goes back to chunks
+// once its score runs out or it shrinks to half the minimum, the gaps keep lists from flipping
+void noteIndexAccess(List* list){
+    list->since_convert++;
+    list->index_score = std::min(list->index_score + LIST_INDEX_WEIGHT, LIST_RING_SCORE_MAX);
+    if(list->encoding == ListEncoding::Chunks && list->index_score >= LIST_RING_SCORE
+       && list->size >= LIST_RING_MIN_SIZE && conversionPaidFor(list)){
+        convertToRing(list);
+    }
+}
 
-        if(currentNode->value != nullptr)
-            delete[] currentNode->value;
-        
-        delete currentNode;
-        currentNode = nextNode;
+void noteEndAccess(List* list){
+    list->since_convert++;
+    if(list->index_score > 0) list->index_score--;
+    if(list->encoding == ListEncoding::Ring && (list->index_score == 0 || list->size < LIST_RING_MIN_SIZE / 2)
+       && conversionPaidFor(list)){
+        convertToChunks(list);
     }
-    
-    // Clean up the header
-    delete[] header->key;
-    header->key = nullptr;
-    header->first = nullptr;
-    header->last = nullptr;
-    header->size = 0;
-    ListTable.size--;
+}
+
+List* allocateList(){
+    List* list = static_cast<List*>(Slabs.allocate(sizeof(List)));
+    *list = List{};
+    list->encoding = ListEncoding::Chunks;
+    return list;
+}
+
+void freeList(List* list){
+    if(list->encoding == ListEncoding::Ring) freeRing(list);
+    else freeChunks(list);
+    Slabs.deallocate(list, sizeof(List));
+}
+
+
+// listpack: a list of at most ListPackMaxEntries elements and ListPackMaxBytes bytes lives in
+// its entry's value bytes, a short one sits in the table slot and needs no allocation at all
+// a 4 byte count comes first, then the elements back to back, each a varint header, the payload
+// and the size of both stored back to front like chunk elements
+// the header is the length shifted left for a string, for an integer it is the zigzag encoded
+// number shifted left with the low bit set, and there is no payload
+// a push past either limit turns the pack into a List, it stays one from then on
+inline size_t ListPackMaxEntries = 128;
+inline size_t ListPackMaxBytes = 1024;
+
+constexpr size_t LIST_PACK_HEADER = sizeof(uint32_t);
+
+struct PackElement{
+    uint64_t header;
+    std::string_view payload;
+    size_t size;
+};
+
+// only canonical decimals, an integer has to read back exactly as it was pushed
+inline bool packInteger(std::string_view value, uint64_t& header){
+    if(value.empty() || value.size() > 20) return false;
 
+    int64_t number;
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+    if(error != std::errc() || end != value.data() + value.size()) return false;
+
+    char text[24];
+    char* text_end = std::to_chars(text, text + sizeof(text), number).ptr;
+    if(std::string_view(text, text_end - text) != value) return false;
+
+    uint64_t zigzag = ((uint64_t) number << 1) ^ (uint64_t) (number >> 63);
+    if(zigzag >> 63) return false;
+    header = zigzag << 1 | 1;
     return true;
 }
 
-bool delListR(std::string key, int list_index)
-{
-    size_t index = getListIndex(key);
+inline PackElement encodePackElement(std::string_view value){
+    PackElement element{value.size() << 1, value, 0};
+    if(packInteger(value, element.header)) element.payload = value.substr(0, 0);
 
-    if(ListTable.nodeHeaders[index].key == nullptr) return false;
+    size_t body = varintSize(element.header) + element.payload.size();
+    element.size = body + varintSize(body);
+    return element;
+}
 
-    NodeHeader* header = &ListTable.nodeHeaders[index];
+inline void writePackElement(char* p, const PackElement& element){
+    char* payload = writeVarint(p, element.header);
+    std::memcpy(payload, element.payload.data(), element.payload.size());
+    writeBackVarint(payload + element.payload.size(), payload + element.payload.size() - p);
+}
 
-    if(header->size <= list_index) 
-    {
-        std::cout << "Index out of bounds\n";
-        return false;
+// the element starting at p, an integer is formatted into buffer
+// returns where the next one starts
+inline const char* readPackElement(const char* p, std::string_view& value, char (&buffer)[24]){
+    const char* payload = p;
+    uint64_t header = readVarint(payload);
+
+    size_t len = 0;
+    if(header & 1){
+        uint64_t zigzag = header >> 1;
+        int64_t number = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+        value = std::string_view(buffer, std::to_chars(buffer, buffer + sizeof(buffer), number).ptr - buffer);
+    }else{
+        len = header >> 1;
+        value = std::string_view(payload, len);
     }
-    
-    Node* currentNode; 
-    if(list_index > (header->size/2)) // If index is closer to last then search from last otherwise search from start
-    {
-        currentNode = header->last;
-        
-        int i = header->size-1;
-        
-        while(i > list_index){
-            currentNode = currentNode->before;
-            --i;
-        }
+
+    size_t body = payload - p + len;
+    return p + body + varintSize(body);
+}
+
+inline char* packData(Entry& e){
+    return entryBytes(e) + e.key_len + 1;
+}
+
+inline const char* packData(const Entry& e){
+    return entryBytes(e) + e.key_len + 1;
+}
+
+inline uint32_t packCount(const Entry& e){
+    uint32_t count;
+    std::memcpy(&count, packData(e), sizeof(count));
+    return count;
+}
+
+inline void setPackCount(Entry& e, uint32_t count){
+    std::memcpy(packData(e), &count, sizeof(count));
+}
+
+// offset of element index in the value bytes, walked from whichever end is closer
+inline size_t packElementAt(const Entry& e, size_t index){
+    const char* data = packData(e);
+    size_t count = packCount(e);
+    const char* p;
+    if(index < count / 2){
+        char buffer[24];
+        std::string_view value;
+        p = data + LIST_PACK_HEADER;
+        for(size_t i = 0; i < index; ++i) p = readPackElement(p, value, buffer);
+    }else{
+        p = data + e.value_len;
+        for(size_t i = count; i > index; --i) p = listElementBefore(p);
     }
-    else{
-        currentNode = header->first;
-        
-        int i = 0;
-
-        while(i < list_index){
-            currentNode = currentNode->after;
-            ++i;
-        }
+    return p - data;
+}
+
+// calls f with every element in order, views of integers only last for the call
+template<class F>
+void forEachPackElement(const Entry& e, F&& f){
+    const char* p = packData(e) + LIST_PACK_HEADER;
+    const char* end = packData(e) + e.value_len;
+    char buffer[24];
+    std::string_view value;
+    while(p < end){
+        p = readPackElement(p, value, buffer);
+        f(value);
     }
+}
 
-    // Handle the case where we're removing the only node
-    if(header->first == header->last) {
-        header->first = nullptr;
-        header->last = nullptr;
+inline bool packFits(const Entry& e, size_t size){
+    return packCount(e) < ListPackMaxEntries && e.value_len + size <= ListPackMaxBytes;
+}
+
+void packPushBack(Entry& e, const PackElement& element){
+    size_t old_len = e.value_len;
+    uint32_t count = packCount(e);
+    char* data = resizeEntryValue(e, old_len + element.size) + e.key_len + 1;
+    writePackElement(data + old_len, element);
+    setPackCount(e, count + 1);
+}
+
+void packPushFront(Entry& e, const PackElement& element){
+    size_t old_len = e.value_len;
+    uint32_t count = packCount(e);
+    char* data = resizeEntryValue(e, old_len + element.size) + e.key_len + 1;
+    std::memmove(data + LIST_PACK_HEADER + element.size, data + LIST_PACK_HEADER, old_len - LIST_PACK_HEADER);
+    writePackElement(data + LIST_PACK_HEADER, element);
+    setPackCount(e, count + 1);
+}
+
+// copies the element at offset out and closes the gap
+void takePackElement(Entry& e, size_t offset, std::string& value){
+    char* data = packData(e);
+    char buffer[24];
+    std::string_view element;
+    size_t size = readPackElement(data + offset, element, buffer) - (data + offset);
+    value = element;
+
+    uint32_t count = packCount(e);
+    std::memmove(data + offset, data + offset + size, e.value_len - offset - size);
+    resizeEntryValue(e, e.value_len - size);
+    setPackCount(e, count - 1);
+}
+
+// the pack's elements move into a chunked List that the entry points to from now on
+List* convertPackToList(Entry& e){
+    List* list = allocateList();
+    forEachPackElement(e, [&](std::string_view value){
+        chunkPushBack(list, value);
+    });
+    setEntryValue(e, std::string_view((const char*) &list, sizeof(list)));
+    e.packed = false;
+    return list;
+}
+
+inline size_t listLength(const Entry& e){
+    return e.packed ? packCount(e) : entryObject<List>(e)->size;
+}
+
+// calls f with every element of either encoding in order
+template<class F>
+void forEachElement(const Entry& e, F&& f){
+    if(e.packed) forEachPackElement(e, f);
+    else forEachListElement(entryObject<List>(e), f);
+}
+
+
+KeyResult findList(std::string_view key, Entry*& e){
+    e = lookupKey(key, hashKey(key));
+    if(e == nullptr) return KeyResult::MissingKey;
+    if(e->type != EntryType::List) return KeyResult::WrongType;
+    return KeyResult::Found;
+}
+
+// a missing key gets a new empty pack
+KeyResult findOrAddList(std::string_view key, Entry*& e){
+    uint64_t hash = hashKey(key);
+    e = lookupKey(key, hash);
+    if(e == nullptr){
+        uint32_t count = 0;
+        Entry entry = makeEntry(key, std::string_view((const char*) &count, sizeof(count)), hash, EntryType::List);
+        entry.packed = true;
+        e = addEntry(entry);
+        return KeyResult::Found;
     }
-    // Handle the case where we're removing the first node
-    else if(currentNode == header->first) {
-        header->first = currentNode->after;
-        header->first->before = nullptr;
+    if(e->type != EntryType::List) return KeyResult::WrongType;
+    return KeyResult::Found;
+}
+
+KeyResult pushBackList(std::string_view key, std::string_view value)
+{
+    Entry* e;
+    KeyResult result = findOrAddList(key, e);
+    if(result != KeyResult::Found) return result;
+
+    if(e->packed){
+        PackElement element = encodePackElement(value);
+        if(packFits(*e, element.size)){
+            packPushBack(*e, element);
+            return KeyResult::Found;
+        }
+        convertPackToList(*e);
     }
-    // Handle the case where we're removing the last node
-    else if(currentNode == header->last) {
-        header->last = currentNode->before;
-        header->last->after = nullptr;
+
+    List* list = entryObject<List>(*e);
+    noteEndAccess(list);
+    if(list->encoding == ListEncoding::Ring) ringPushBack(list, value);
+    else chunkPushBack(list, value);
+    return KeyResult::Found;
+}
+
+KeyResult pushFrontList(std::string_view key, std::string_view value)
+{
+    Entry* e;
+    KeyResult result = findOrAddList(key, e);
+    if(result != KeyResult::Found) return result;
+
+    if(e->packed){
+        PackElement element = encodePackElement(value);
+        if(packFits(*e, element.size)){
+            packPushFront(*e, element);
+            return KeyResult::Found;
+        }
+        convertPackToList(*e);
     }
-    // Handle the case where we're removing a middle node
-    else {
-        currentNode->before->after = currentNode->after;
-        currentNode->after->before = currentNode->before;
+
+    List* list = entryObject<List>(*e);
+    noteEndAccess(list);
+    if(list->encoding == ListEncoding::Ring) ringPushFront(list, value);
+    else chunkPushFront(list, value);
+    return KeyResult::Found;
+}
+
+// copies the element out and removes it, the key goes away with the last element
+void takeListElement(std::string_view key, Entry* e, size_t index, std::string& value){
+    if(e->packed){
+        takePackElement(*e, packElementAt(*e, index), value);
+    }else{
+        List* list = entryObject<List>(*e);
+        if(list->encoding == ListEncoding::Ring){
+            value = listValue(ringSlot(list, index));
+            removeRingElement(list, index);
+        }else{
+            size_t offset;
+            ListChunk* chunk = listElementAt(list, index, offset);
+            std::string_view element;
+            readListElement(chunkData(chunk) + offset, element);
+            value = element;
+            removeChunkElement(list, chunk, offset);
+        }
     }
+    if(listLength(*e) == 0) delKey(key);
+}
 
-    header->size--;
+KeyResult popBackList(std::string_view key, std::string& value)
+{
+    Entry* e;
+    KeyResult result = findList(key, e);
+    if(result != KeyResult::Found) return result;
 
-    delete[] currentNode->value;
-    delete currentNode;
+    if(!e->packed) noteEndAccess(entryObject<List>(*e));
+    takeListElement(key, e, listLength(*e) - 1, value);
+    return KeyResult::Found;
+}
 
-    return true;
+KeyResult popFrontList(std::string_view key, std::string& value)
+{
+    Entry* e;
+    KeyResult result = findList(key, e);
+    if(result != KeyResult::Found) return result;
+
+    if(!e->packed) noteEndAccess(entryObject<List>(*e));
+    takeListElement(key, e, 0, value);
+    return KeyResult::Found;
 }
 
-std::string getListKeys()
+
+// views point into the list or into scratch, only valid until either is modified
+// scratch holds the packed integers, which have no bytes of their own to point at
+KeyResult getList(std::string_view key, std::vector<std::string_view>& values, std::string& scratch)
 {
-    std::string result = "";
+    values.clear();
+    Entry* e;
+    KeyResult result = findList(key, e);
+    if(result != KeyResult::Found) return result;
+
+    values.reserve(listLength(*e));
+    if(!e->packed){
+        forEachListElement(entryObject<List>(*e), [&](std::string_view value){
+            values.push_back(value);
+        });
+        return KeyResult::Found;
+    }
 
-    if(ListTable.size == 0) return "\n";
+    // never reallocates, no integer is longer than 20 characters
+    scratch.clear();
+    scratch.reserve(packCount(*e) * 20);
+    const char* p = packData(*e) + LIST_PACK_HEADER;
+    const char* end = packData(*e) + e->value_len;
+    char buffer[24];
+    std::string_view value;
+    while(p < end){
+        p = readPackElement(p, value, buffer);
+        if(value.data() == buffer){
+            scratch.append(value);
+            value = std::string_view(scratch.data() + scratch.size() - value.size(), value.size());
+        }
+        values.push_back(value);
+    }
+    return KeyResult::Found;
+}
 
-    for(int i = 0; i < ListTable.capacity; ++i){
-        if(ListTable.nodeHeaders[i].key != nullptr){
-            result.append(ListTable.nodeHeaders[i].key);
-            result.append(" ");
+// value points into the list or into scratch like getList
+KeyResult getListR(std::string_view key, int64_t list_index, std::string_view& value, std::string& scratch)
+{
+    Entry* e;
+    KeyResult result = findList(key, e);
+    if(result != KeyResult::Found) return result;
+
+    if(list_index < 0 || listLength(*e) <= (size_t) list_index) return KeyResult::OutOfRange;
+
+    if(e->packed){
+        char buffer[24];
+        readPackElement(packData(*e) + packElementAt(*e, list_index), value, buffer);
+        if(value.data() == buffer){
+            scratch.assign(value);
+            value = scratch;
         }
+        return KeyResult::Found;
     }
 
+    List* list = entryObject<List>(*e);
+    noteIndexAccess(list);
+    if(list->encoding == ListEncoding::Ring){
+        value = listValue(ringSlot(list, list_index));
+        return KeyResult::Found;
+    }
 
-    result.append("\n");
-    
-    // std::cout << "LKEYS OBTAINED" << "\n";
-    return result;
+    size_t offset;
+    ListChunk* chunk = listElementAt(list, list_index, offset);
+    readListElement(chunkData(chunk) + offset, value);
+    return KeyResult::Found;
 }
 
-void getSnapList(rapidjson::Writer<rapidjson::StringBuffer>& writer)
+KeyResult listSize(std::string_view key, size_t& size)
 {
-    
-    /*
-    std::string result = "LISTS ";
-
-    for(int i = 0; i < ListTable.capacity; i++){
-        
-
-    if(ListTable.nodeHeaders[i].key == nullptr) continue;
-    NodeHeader* header = &ListTable.nodeHeaders[i];
-
-    Node* currentNode = header->first;
-
-    result.append(std::to_string(header->size));
-    result.append(" ");
-    result.append(header->key);
-    result.append(" ");
-    while(currentNode != nullptr)
-    {
-        
-    result.append(currentNode->value);
-    result.append(" ");
-    currentNode = currentNode->after;
-    }
-    
-    }
+    Entry* e;
+    KeyResult result = findList(key, e);
+    size = result == KeyResult::Found ? listLength(*e) : 0;
     return result;
-    */
-
-
-    for(int i = 0; i < ListTable.capacity; i++)
-   {
-       if(ListTable.nodeHeaders[i].key == nullptr) continue;
-       
-       NodeHeader* header = &ListTable.nodeHeaders[i];
-       
-       Node* currentNode = header->first;
-       
-       writer.Key(header->key);
-       writer.StartArray();
-       while(currentNode != nullptr)
-       {
-           writer.String(currentNode->value);
-           currentNode = currentNode->after;
+}
+
+KeyResult delList(std::string_view key)
+{
+    Entry* e;
+    KeyResult result = findList(key, e);
+    if(result != KeyResult::Found) return result;
+
+    delKey(key);
+    return KeyResult::Found;
+}
+
+KeyResult delListR(std::string_view key, int64_t list_index)
+{
+    Entry* e;
+    KeyResult result = findList(key, e);
+    if(result != KeyResult::Found) return result;
+
+    if(list_index < 0 || listLength(*e) <= (size_t) list_index) return KeyResult::OutOfRange;
+
+    if(e->packed){
+        std::string value;
+        takePackElement(*e, packElementAt(*e, list_index), value);
+    }else{
+        List* list = entryObject<List>(*e);
+        noteIndexAccess(list);
+        if(list->encoding == ListEncoding::Ring){
+            removeRingElement(list, list_index);
+        }else{
+            size_t offset;
+            ListChunk* chunk = listElementAt(list, list_index, offset);
+            removeChunkElement(list, chunk, offset);
         }
+    }
+    if(listLength(*e) == 0) delKey(key);
+    return KeyResult::Found;
+}
+
+// views point into the table, only valid until it is modified
+void getListKeys(std::vector<std::string_view>& keys)
+{
+    getKeys(keys, EntryType::List);
+}
+
+void getSnapList(rapidjson::Writer<rapidjson::StringBuffer>& writer)
+{
+    Keyspace.for_each([&](const Entry& e){
+        if(e.type != EntryType::List) return;
+
+        std::string_view key = entryKey(e);
+        writer.Key(key.data(), key.size());
+        writer.StartArray();
+        forEachElement(e, [&](std::string_view value){
+            writer.String(value.data(), value.size());
+        });
         writer.EndArray();
-    }   
+    });
 }
@@ -0,0 +1,89 @@
+#ifndef RESP_H
+#define RESP_H
+
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include "ioBuffer.h"
+
+// RESP request parsing and reply encoding
+// bulk strings are length prefixed so payloads are skipped, never scanned
+
+
+constexpr int64_t RESP_MAX_ARGS = 1024 * 1024;
+constexpr int64_t RESP_MAX_BULK = 512 * 1024 * 1024;
+
+// reads "<prefix><integer>\r\n" at data[pos], returns false when incomplete or malformed
+inline bool parseRespLength(const char* data, size_t size, size_t& pos, char prefix, int64_t& value, bool& malformed){
+    if(pos >= size) return false;
+    if(data[pos] != prefix){
+        malformed = true;
+        return false;
+    }
+
+    // headers are short, only this line is searched for its terminator
+    const char* start = data + pos + 1;
+    const char* line_end = (const char*) std::memchr(start, '\r', size - pos - 1);
+    if(line_end == nullptr || line_end + 1 >= data + size) return false;
+
+    auto result = std::from_chars(start, line_end, value);
+    if(result.ec != std::errc() || result.ptr != line_end || line_end[1] != '\n'){
+        malformed = true;
+        return false;
+    }
+
+    pos = line_end + 2 - data;
+    return true;
+}
+
+// parses one "*<n>\r\n$<len>\r\n<bytes>\r\n..." command into argv
+// returns the bytes consumed, 0 if the command is not complete yet, -1 on a protocol error
+inline long parseRespCommand(const char* data, size_t size, std::vector<std::string_view>& argv){
+    argv.clear();
+    size_t pos = 0;
+    bool malformed = false;
+
+    int64_t count;
+    if(!parseRespLength(data, size, pos, '*', count, malformed)) return malformed ? -1 : 0;
+    if(count < 0 || count > RESP_MAX_ARGS) return -1;
+
+    for(int64_t i = 0; i < count; ++i){
+        int64_t len;
+        if(!parseRespLength(data, size, pos, '$', len, malformed)) return malformed ? -1 : 0;
+        if(len < 0 || len > RESP_MAX_BULK) return -1;
+
+        if(pos + len + 2 > size) return 0;
+        if(data[pos + len] != '\r' || data[pos + len + 1] != '\n') return -1;
+
+        argv.emplace_back(data + pos, len);
+        pos += len + 2;
+    }
+
+    return (long) pos;
+}
+
+
+inline void appendRespHeader(WriteChain& out, char prefix, int64_t value){
+    char header[24];
+    header[0] = prefix;
+    char* end = std::to_chars(header + 1, header + sizeof(header) - 2, value).ptr;
+    end[0] = '\r';
+    end[1] = '\n';
+    appendChain(out, header, end + 2 - header);
+}
+
+inline void appendRespBulk(WriteChain& out, std::string_view value){
+    appendRespHeader(out, '$', value.size());
+    appendChain(out, value.data(), value.size());
+    appendChain(out, "\r\n", 2);
+}
+
+inline void appendRespLine(WriteChain& out, char prefix, std::string_view line){
+    appendChain(out, &prefix, 1);
+    appendChain(out, line.data(), line.size());
+    appendChain(out, "\r\n", 2);
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "tokenizer.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// block-wise request scanning, every block yields a whitespace mask and a newline mask
+// so the terminator and all token boundaries of a line come out of a single pass
+// AVX2 handles 32 bytes per step, SSE2 (always there on x86-64) 16, anything else is scalar
+
+
+#if defined(__AVX2__)
+
+constexpr size_t SCAN_BLOCK = 32;
+
+inline void classifyBlock(const char* p, uint32_t& ws, uint32_t& nl){
+    __m256i v = _mm256_loadu_si256((const __m256i*) p);
+    __m256i is_nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    __m256i is_space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    // '\t' '\n' '\v' '\f' '\r' are 9..13, one unsigned range check covers them
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+    __m256i is_ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t);
+    ws = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(is_space, is_ctl));
+    nl = (uint32_t) _mm256_movemask_epi8(is_nl);
+}
+
+inline uint32_t newlineMask(const char* p){
+    __m256i v = _mm256_loadu_si256((const __m256i*) p);
+    return (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+
+#elif defined(__SSE2__)
+
+constexpr size_t SCAN_BLOCK = 16;
+
+inline void classifyBlock(const char* p, uint32_t& ws, uint32_t& nl){
+    __m128i v = _mm_loadu_si128((const __m128i*) p);
+    __m128i is_nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    __m128i is_space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    // '\t' '\n' '\v' '\f' '\r' are 9..13, one unsigned range check covers them
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(9));
+    __m128i is_ctl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+    ws = (uint32_t) _mm_movemask_epi8(_mm_or_si128(is_space, is_ctl));
+    nl = (uint32_t) _mm_movemask_epi8(is_nl);
+}
+
+inline uint32_t newlineMask(const char* p){
+    __m128i v = _mm_loadu_si128((const __m128i*) p);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+
+#else
+
+constexpr size_t SCAN_BLOCK = 16;
+
+inline void classifyBlock(const char* p, uint32_t& ws, uint32_t& nl){
+    ws = 0;
+    nl = 0;
+    for(size_t i = 0; i < SCAN_BLOCK; ++i){
+        if(isCommandSpace(p[i])) ws |= 1u << i;
+        if(p[i] == '\n') nl |= 1u << i;
+    }
+}
+
+inline uint32_t newlineMask(const char* p){
+    uint32_t nl = 0;
+    for(size_t i = 0; i < SCAN_BLOCK; ++i){
+        if(p[i] == '\n') nl |= 1u << i;
+    }
+    return nl;
+}
+
+#endif
+
+// the last partial block of the buffer, never read past size
+inline void classifyTail(const char* p, size_t len, uint32_t& ws, uint32_t& nl){
+    ws = 0;
+    nl = 0;
+    for(size_t i = 0; i < len; ++i){
+        if(isCommandSpace(p[i])) ws |= 1u << i;
+        if(p[i] == '\n') nl |= 1u << i;
+    }
+}
+
+
+// offset of the first '\n' in [from, size), or size when there is none
+inline size_t findNewline(const char* data, size_t from, size_t size){
+    size_t pos = from;
+    while(size - pos >= SCAN_BLOCK){
+        uint32_t nl = newlineMask(data + pos);
+        if(nl != 0) return pos + __builtin_ctz(nl);
+        pos += SCAN_BLOCK;
+    }
+    for(; pos < size; ++pos){
+        if(data[pos] == '\n') return pos;
+    }
+    return size;
+}
+
+// splits the first line of data into argv while looking for its terminator
+// returns false when the line is not complete yet, line_len excludes the '\n'
+inline bool tokenizeLine(const char* data, size_t size, std::vector<std::string_view>& argv, size_t& line_len){
+    argv.clear();
+
+    size_t pos = 0;
+    size_t token_start = 0;
+    bool in_token = false;
+
+    while(pos < size){
+        uint32_t ws, nl;
+        size_t n = size - pos;
+        if(n >= SCAN_BLOCK){
+            classifyBlock(data + pos, ws, nl);
+            n = SCAN_BLOCK;
+        }else{
+            classifyTail(data + pos, n, ws, nl);
+        }
+
+        bool found = nl != 0;
+        if(found) n = __builtin_ctz(nl);
+
+        uint32_t limit = n >= 32 ? 0xffffffffu : ((1u << n) - 1);
+        uint32_t word = ~ws & limit;                            // bytes that belong to a token
+        uint32_t prev = (word << 1) | (in_token ? 1u : 0u);     // same, shifted by one byte
+        uint32_t starts = word & ~prev;
+        uint32_t ends = ~word & prev & limit;
+
+        // starts and ends alternate, walk them in byte order
+        uint32_t edges = starts | ends;
+        while(edges != 0){
+            uint32_t bit = __builtin_ctz(edges);
+            if(starts & (1u << bit)){
+                token_start = pos + bit;
+            }else{
+                argv.emplace_back(data + token_start, pos + bit - token_start);
+            }
+            edges &= edges - 1;
+        }
+
+        if(n > 0) in_token = (word >> (n - 1)) & 1u;
+
+        if(found){
+            if(in_token) argv.emplace_back(data + token_start, pos + n - token_start);
+            line_len = pos + n;
+            return true;
+        }
+        pos += n;
+    }
+
+    return false;
+}
+
+#endif
@@ -1,15 +1,21 @@
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <fcntl.h>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
-#include <sstream>
+#include <string_view>
+#include <span>
 #include <variant>
 #include <deque>
 #include <fstream>
+#include <algorithm>
+#include <memory>
+#include <functional>
 
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
@@ -19,6 +25,45 @@
 #include "dict.h"
 #include "llist.h"
 #include "jsonReader.h"
+#include "ioBuffer.h"
+#include "tokenizer.h"
+#include "scan.h"
+#include "dispatch.h"
+#include "resp.h"
+#include "ioThreads.h"
+#include "shard.h"
+
+#ifdef FASTCACHE_IO_URING
+#include "uring.h"
+#endif
+
+
+enum class Backend{
+    Epoll,
+    Uring
+};
+
+// when queued replies of a connection are written to the socket
+enum class FlushPolicy{
+    Immediate,      // after every command
+    EndOfBatch,     // once per read batch, one writev for all of its replies
+    Cork            // hold replies until cork_bytes are queued or the event loop goes idle
+};
+
+// picked per connection from its first byte, RESP clients always start with '*'
+enum class Protocol{
+    Unknown,
+    Text,           // newline terminated, whitespace separated
+    Resp2,
+    Resp3           // after HELLO 3
+};
+
+// outcome of draining a socket in one direction
+enum class IoStatus{
+    Done,           // read until EAGAIN, or every reply written
+    Pending,        // read batch limit hit, or the socket buffer is full
+    Closed          // peer gone or error, the client has to be cleaned up
+};
 
 
 class redisServer{
@@ -26,30 +71,102 @@ class redisServer{
     public:
     int m_server_fd;
     int m_epoll_fd;
+    Backend m_backend;
+
+    struct ParsedCommand{
+        size_t argc;
+        size_t bytes;           // consumed from the read buffer once it has run
+        bool protocol_error;
+    };
+
+    // a reply that has to wait for one owed by another shard to keep pipelined replies in order
+    struct ReplySlot{
+        std::string bytes;
+        bool ready = false;
+    };
     
     struct ClientState{
-        std::string buffer;
-        std::string write_buffer;
-        bool command_complete = false;
+        int fd = -1;
+        uint64_t id = 0;        // tells a reused fd apart when another shard replies late
+        ReadBuffer buffer;
+        size_t scanned = 0;     // bytes of a partial text line already known to hold no '\n'
+        Protocol protocol = Protocol::Unknown;
+        bool epollout_armed = false;
+
+        // queued replies, written out together with writev
+        WriteChain replies;
+
+        FlushPolicy flush_policy = FlushPolicy::EndOfBatch;
+        size_t cork_bytes = 0;
+        bool corked = false;
+
+        // io_uring backend only
+        WriteChain inflight;    // replies owned by a submitted sendmsg until it completes
+        std::vector<iovec> inflight_iov;
+        msghdr inflight_msg;
+        int pending_ops = 0;    // submitted sqes that still reference this client
+        bool closing = false;
+
+        // threaded I/O only, commands an I/O thread parsed for the executor
+        std::vector<std::string_view> parsed_argv;
+        std::vector<ParsedCommand> parsed;
+        IoStatus io_status = IoStatus::Done;
+
+        // sharding only, replies still owed by other shards, oldest first
+        std::deque<ReplySlot> reply_slots;
+        uint64_t reply_seq = 0;     // sequence number of the next reserved slot
     };
 
+    // runs on the shard it was submitted to
+    using ShardTask = std::function<void(redisServer&)>;
+
     std::unordered_map<int, ClientState> m_clients;
 
-    std::unordered_map<std::string, std::string> m_string_cache;
-    std::unordered_map<std::string, std::deque<std::string>> m_list_cache;
 
-    redisServer(int port = 5555){
-        setup_server(port);
-        setup_epoll();
+    // reuse_port lets several reactors bind the same port, the kernel spreads
+    // incoming connections across their listening sockets
+    // io_threads > 1 moves socket reads, parsing and writes of the epoll backend onto
+    // helper threads while commands keep running on this one
+    // with shards every reactor owns the keys hashing to its shard index and forwards
+    // commands for all other keys to their owner
+    redisServer(int port = 5555, bool reuse_port = false, Backend backend = Backend::Epoll, int io_threads = 1,
+                ShardSet<ShardTask>* shards = nullptr, size_t shard = 0){
+        m_backend = backend;
+        if(shards != nullptr && shards->count > 1){
+            m_shards = shards;
+            m_shard = shard;
+            m_wake_fd = shards->wake_fds[shard];
+            m_outbox.resize(shards->count);
+            m_wake.resize(shards->count, false);
+        }
+
+        setup_server(port, reuse_port);
+        if(m_backend == Backend::Uring){
+            setup_uring();
+        }else{
+            setup_epoll();
+        }
+
+        if(io_threads > 1 && m_backend == Backend::Epoll){
+            m_io_threads = std::make_unique<IoThreadPool>(io_threads - 1);
+            m_share_argv.resize(m_io_threads->size());
+        }
     }
 
 
     void run_server(){
+        if(m_backend == Backend::Uring){
+            run_uring();
+            return;
+        }
         
         struct epoll_event events[1024];
         std::cout << "Server Started...";
         while(true){
-            int nfds = epoll_wait(m_epoll_fd, events, 1024, -1);
+            // clients that hit the read batch limit still have input waiting, don't block
+            // a growing table is migrated whenever the loop would otherwise sit idle
+            bool busy = !m_read_again.empty() || shard_backlog() || keyspaceRehashing();
+            int nfds = epoll_wait(m_epoll_fd, events, 1024, busy ? 0 : -1);
 
             if (nfds == -1){
                 if(errno == EINTR){
@@ -59,6 +176,10 @@ class redisServer{
                 break;
             }
 
+            if(nfds == 0 && keyspaceRehashing()){
+                rehashKeyspaceFor(IDLE_REHASH_BUDGET);
+            }
+
             // std::cout << "Data Received\n";
 
             for(int i = 0; i < nfds; i++){
@@ -66,21 +187,313 @@ class redisServer{
 
                 if(fd == m_server_fd){
                     accept_new_clients();
+                    continue;
+                }
+
+                if(fd == m_wake_fd){
+                    uint64_t count;
+                    if(read(m_wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("read eventfd");
+                    drain_shard_inbox();
+                    continue;
+                }
+
+                if(m_io_threads){
+                    // handed to the I/O threads below, all readable clients at once
+                    if(events[i].events & EPOLLIN) m_read_jobs.push_back(fd);
+                    if(events[i].events & EPOLLOUT) m_pending_sends.push_back(fd);
                 }else if(events[i].events & EPOLLIN){
                     read_from_client(fd);
-                }else if(events[i].events & EPOLLOUT){
+                }
+
+                // EPOLLOUT is only armed while a reply did not fit in the socket buffer
+                if(m_io_threads){
+                    if(!(events[i].events & (EPOLLIN | EPOLLOUT)) && (events[i].events & (EPOLLHUP | EPOLLERR))){
+                        cleanup_client(fd);
+                    }
+                }else if((events[i].events & EPOLLOUT) && m_clients.count(fd)){
                     write_to_client(fd);
-                }else if(events[i].events & (EPOLLHUP | EPOLLERR)){
+                }else if(!(events[i].events & (EPOLLIN | EPOLLOUT)) && (events[i].events & (EPOLLHUP | EPOLLERR))){
                     cleanup_client(fd);
                 }
 
             }
+
+            if(m_io_threads){
+                read_batch_threaded();
+                flush_corked_clients();
+                write_batch_threaded();
+            }else{
+                flush_corked_clients();
+            }
+            flush_shard_messages();
         }
     }
 
     private:
 
-    void setup_server(int port){
+    std::vector<int> m_pending_sends;   // io_uring and threaded I/O: clients with replies queued this iteration
+    std::vector<int> m_corked;          // clients holding back replies until the event loop goes idle
+    std::vector<std::string_view> m_argv;   // reused for every command
+    std::vector<std::string_view> m_items;  // reused for array replies
+    std::string m_item_bytes;               // integers of packed lists, formatted for replies
+
+    // threaded I/O, see read_batch_threaded and write_batch_threaded
+    struct IoJob{
+        int fd;
+        ClientState* client;
+    };
+
+    static constexpr size_t READ_BATCH_LIMIT = 256 * 1024;     // per client per iteration
+    static constexpr std::chrono::microseconds IDLE_REHASH_BUDGET{1000};
+
+    std::unique_ptr<IoThreadPool> m_io_threads;
+    std::vector<std::vector<std::string_view>> m_share_argv;   // parse scratch, one per share
+    std::vector<int> m_read_jobs;
+    std::vector<int> m_read_again;
+    std::vector<IoJob> m_io_jobs;
+
+    // sharding, see execute_command and gather_shards
+    ShardSet<ShardTask>* m_shards = nullptr;
+    size_t m_shard = 0;
+    int m_wake_fd = -1;
+    std::vector<std::deque<ShardTask>> m_outbox;    // tasks waiting for room in a full queue
+    std::vector<bool> m_wake;                       // shards sent tasks since the last flush
+    uint64_t m_next_client_id = 1;
+    ClientState m_remote_client;                    // encodes replies for commands run on behalf of other shards
+    std::vector<std::string_view> m_remote_argv;
+
+#ifdef FASTCACHE_IO_URING
+    enum UringOp : uint64_t{
+        OP_ACCEPT = 1,
+        OP_RECV = 2,
+        OP_SEND = 3,
+        OP_WAKE = 4
+    };
+
+    ioUring m_ring;
+    ioBufferRing m_recv_buffers;
+    uint64_t m_wake_count;
+    std::vector<uint64_t> m_unarmed;    // user data of operations waiting for a free sqe, oldest first
+
+    static uint64_t uring_data(UringOp op, int fd){
+        return (op << 32) | (uint32_t) fd;
+    }
+
+    void setup_uring(){
+        initUring(m_ring, 4096);
+        initBufferRing(m_ring, m_recv_buffers, 0, 512, 4096);
+        arm_accept();
+        if(m_shards != nullptr) arm_wake();
+    }
+
+    // other shards write the eventfd after queueing tasks for this one
+    void arm_wake(){
+        arm(OP_WAKE, m_wake_fd);
+    }
+
+    void arm_accept(){
+        arm(OP_ACCEPT, m_server_fd);
+    }
+
+    void arm_recv(int fd){
+        m_clients[fd].pending_ops++;
+        arm(OP_RECV, fd);
+    }
+
+    void arm_send(int fd, ClientState& client){
+        client.inflight_iov.resize(std::min(chainSegments(client.inflight), (size_t) IOV_MAX));
+        size_t count = fillIovecs(client.inflight, client.inflight_iov.data(), client.inflight_iov.size());
+
+        std::memset(&client.inflight_msg, 0, sizeof(client.inflight_msg));
+        client.inflight_msg.msg_iov = client.inflight_iov.data();
+        client.inflight_msg.msg_iovlen = count;
+
+        client.pending_ops++;
+        arm(OP_SEND, fd);
+    }
+
+    // an operation that finds the submission queue full waits in m_unarmed, it already counts
+    // as pending so its client can't be closed before it has been submitted and completed
+    void arm(UringOp op, int fd){
+        io_uring_sqe* sqe = m_unarmed.empty() ? getSqe(m_ring) : nullptr;
+        if(sqe == nullptr){
+            m_unarmed.push_back(uring_data(op, fd));
+            return;
+        }
+        prepare_sqe(sqe, op, fd);
+    }
+
+    // run after the completion queue was drained, that is what lets the kernel take sqes again
+    void arm_deferred(){
+        size_t armed = 0;
+        for(; armed < m_unarmed.size(); ++armed){
+            io_uring_sqe* sqe = getSqe(m_ring);
+            if(sqe == nullptr) break;
+            uint64_t data = m_unarmed[armed];
+            prepare_sqe(sqe, (UringOp)(data >> 32), (int)(data & 0xffffffff));
+        }
+        m_unarmed.erase(m_unarmed.begin(), m_unarmed.begin() + armed);
+    }
+
+    void prepare_sqe(io_uring_sqe* sqe, UringOp op, int fd){
+        sqe->fd = fd;
+        sqe->user_data = uring_data(op, fd);
+
+        if(op == OP_WAKE){
+            sqe->opcode = IORING_OP_READ;
+            sqe->addr = (uint64_t) &m_wake_count;
+            sqe->len = sizeof(m_wake_count);
+            sqe->off = (uint64_t) -1;
+        }else if(op == OP_ACCEPT){
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        }else if(op == OP_RECV){
+            sqe->opcode = IORING_OP_RECV;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = m_recv_buffers.group;
+        }else{
+            // the message was filled in by arm_send and stays put until the send completes
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = (uint64_t) &m_clients[fd].inflight_msg;
+            sqe->len = 1;
+            sqe->msg_flags = MSG_NOSIGNAL;
+        }
+    }
+
+    void run_uring(){
+        std::cout << "Server Started (io_uring)...";
+        while(true){
+            // completions were drained last iteration, operations that found the queue full go first
+            arm_deferred();
+            flush_corked_clients();
+            flush_uring_sends();
+            flush_shard_messages();
+            bool rehashing = keyspaceRehashing();
+            // a submit the kernel refused (EBUSY) returns at once, the loop then reaps completions
+            submitUring(m_ring, shard_backlog() || rehashing || !m_unarmed.empty() ? 0 : 1);
+
+            if(rehashing && peekCqe(m_ring) == nullptr){
+                rehashKeyspaceFor(IDLE_REHASH_BUDGET);
+            }
+
+            io_uring_cqe* cqe;
+            while((cqe = peekCqe(m_ring)) != nullptr){
+                UringOp op = (UringOp)(cqe->user_data >> 32);
+                int fd = (int)(cqe->user_data & 0xffffffff);
+                int res = cqe->res;
+                uint32_t flags = cqe->flags;
+                seenCqe(m_ring);
+
+                if(op == OP_ACCEPT){
+                    handle_accept(res, flags);
+                }else if(op == OP_RECV){
+                    handle_recv(fd, res, flags);
+                }else if(op == OP_SEND){
+                    handle_send(fd, res);
+                }else if(op == OP_WAKE){
+                    drain_shard_inbox();
+                    arm_wake();
+                }
+            }
+        }
+    }
+
+    // one sendmsg per client per loop iteration, covering every reply produced since the last one
+    void flush_uring_sends(){
+        for(int fd: m_pending_sends){
+            auto it = m_clients.find(fd);
+            if(it == m_clients.end()) continue;
+
+            ClientState& client = it->second;
+            if(client.closing || client.inflight.bytes > 0 || client.replies.bytes == 0) continue;
+
+            std::swap(client.inflight, client.replies);
+            arm_send(fd, client);
+        }
+        m_pending_sends.clear();
+    }
+
+    void handle_accept(int res, uint32_t flags){
+        if(res >= 0){
+            std::cout << "New Client Connected: " << res << std::endl;
+            add_client(res);
+            arm_recv(res);
+        }else{
+            errno = -res;
+            perror("accept");
+        }
+
+        if(!(flags & IORING_CQE_F_MORE)) arm_accept();
+    }
+
+    void handle_recv(int fd, int res, uint32_t flags){
+        auto& client = m_clients[fd];
+
+        if(res > 0){
+            uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+            if(!client.closing){
+                appendRead(client.buffer, getRingBuffer(m_recv_buffers, bid), res);
+                process_complete_commands(fd);
+                finish_read_batch(fd);
+            }
+            recycleRingBuffer(m_recv_buffers, bid);
+        }
+
+        if(flags & IORING_CQE_F_MORE) return;
+
+        client.pending_ops--;
+        if(!client.closing && (res > 0 || res == -ENOBUFS)){
+            arm_recv(fd);
+            return;
+        }
+
+        if(res == 0) std::cout << "Client " << fd << " Disconnected\n";
+        close_uring_client(fd);
+    }
+
+    void handle_send(int fd, int res){
+        auto& client = m_clients[fd];
+        client.pending_ops--;
+
+        if(res < 0 || client.closing){
+            close_uring_client(fd);
+            return;
+        }
+
+        consumeChain(client.inflight, res);
+        if(client.inflight.bytes > 0){
+            arm_send(fd, client);
+            return;
+        }
+
+        if(client.replies.bytes > 0) m_pending_sends.push_back(fd);
+    }
+
+    // the fd stays open until every sqe referencing it has completed so its number cannot be reused
+    void close_uring_client(int fd){
+        auto& client = m_clients[fd];
+        if(!client.closing){
+            client.closing = true;
+            shutdown(fd, SHUT_RDWR);
+        }
+
+        if(client.pending_ops == 0){
+            close(fd);
+            release_client_buffers(client);
+            m_clients.erase(fd);
+        }
+    }
+#else
+    void setup_uring(){
+        std::cout << "io_uring backend not compiled in\n";
+        exit(EXIT_FAILURE);
+    }
+
+    void run_uring(){}
+#endif
+
+    void setup_server(int port, bool reuse_port){
         
         m_server_fd = socket(AF_INET, SOCK_STREAM, 0);
         if(m_server_fd < 0){
@@ -88,6 +501,14 @@ class redisServer{
             exit(EXIT_FAILURE);
         }
 
+        if(reuse_port){
+            int opt = 1;
+            if(setsockopt(m_server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0){
+                perror("SO_REUSEPORT Failure");
+                exit(EXIT_FAILURE);
+            }
+        }
+
         struct sockaddr_in addr;
         addr.sin_addr.s_addr = INADDR_ANY;
         addr.sin_family = AF_INET;
@@ -117,6 +538,9 @@ class redisServer{
 
 
         add_to_epoll(m_server_fd, EPOLLIN);
+
+        // level triggered, it stays readable until the event loop reads the counter
+        if(m_shards != nullptr) add_to_epoll(m_wake_fd, EPOLLIN);
     }
 
     void make_non_blocking(int fd){
@@ -175,19 +599,27 @@ class redisServer{
 
             make_non_blocking(client_fd);
             add_to_epoll(client_fd, EPOLLIN | EPOLLET);
-            m_clients[client_fd] = ClientState{};
+            add_client(client_fd);
         }
     }
 
+    void add_client(int fd){
+        ClientState& client = m_clients[fd] = ClientState{};
+        client.fd = fd;
+        client.id = m_next_client_id++;
+    }
+
     void read_from_client(int fd){
-        char buffer[1024];
         while(true){
-            ssize_t bytes = read(fd, buffer, sizeof(buffer));
+            // read straight into the connection buffer
+            auto& client = m_clients[fd];
+            size_t space;
+            char* buffer = readSpace(client.buffer, space);
+            ssize_t bytes = read(fd, buffer, space);
 
             if(bytes > 0){
-                m_clients[fd].buffer.append(buffer, bytes);
-                std::cout << "COMMAND: " << m_clients[fd].buffer;
-                process_complete_commands(fd);
+                commitRead(client.buffer, bytes);
+                if(!process_complete_commands(fd)) break;
             }
             else if(bytes == 0){
                 std::cout << "Client " << fd << " Disconnected\n";
@@ -195,6 +627,8 @@ class redisServer{
                 break;
             }
             else if(bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                // every reply for this read batch is queued, try to write it out right away
+                finish_read_batch(fd);
                 break;
             }
             else{
@@ -205,417 +639,937 @@ class redisServer{
         }
     }
 
-    void write_to_client(int fd){
-        auto& client = m_clients[fd];
+    // returns false if the client had to be closed
+    bool write_to_client(int fd){
+        return finish_write(fd, write_replies(fd, m_clients[fd]));
+    }
+
+    // writes until the chain is empty or the socket is full, safe on an I/O thread
+    IoStatus write_replies(int fd, ClientState& client){
+        iovec iov[IOV_MAX];
 
-        while(!client.write_buffer.empty()){
-            ssize_t bytes = write(fd, client.write_buffer.c_str(), client.write_buffer.size());
+        while(client.replies.bytes > 0){
+            size_t count = fillIovecs(client.replies, iov, IOV_MAX);
+            ssize_t bytes = writev(fd, iov, count);
 
             if(bytes > 0){
-                client.write_buffer.erase(0, bytes);
+                consumeChain(client.replies, bytes);
             }else if(errno == EAGAIN || errno == EWOULDBLOCK){
-                break;
+                return IoStatus::Pending;
             }else{
-                cleanup_client(fd);
-                break;
+                return IoStatus::Closed;
             }
         }
+        return IoStatus::Done;
+    }
+
+    // returns false if the client had to be closed
+    bool finish_write(int fd, IoStatus status){
+        if(status == IoStatus::Closed){
+            cleanup_client(fd);
+            return false;
+        }
 
-        
+        // socket buffer is full, let epoll tell us when it drains
+        auto& client = m_clients[fd];
+        bool want_epollout = status == IoStatus::Pending;
+        if(want_epollout != client.epollout_armed){
+            modify_epoll(fd, want_epollout ? (EPOLLIN | EPOLLOUT | EPOLLET) : (EPOLLIN | EPOLLET));
+            client.epollout_armed = want_epollout;
+        }
+        return true;
     }
 
-    void process_complete_commands(int fd){
+    bool flush_due(const ClientState& client){
+        if(client.flush_policy == FlushPolicy::Immediate) return true;
+        return client.flush_policy == FlushPolicy::Cork && client.replies.bytes >= client.cork_bytes;
+    }
+
+    // called once a read batch has been fully processed
+    void finish_read_batch(int fd){
         auto& client = m_clients[fd];
-        while(true){
-            auto cmd_end = client.buffer.find("\n");
-            if (cmd_end == std::string::npos) break;
-            
-            std::string command = client.buffer.substr(0, cmd_end);
-            client.buffer.erase(0, cmd_end + 1);
+        if(client.replies.bytes == 0) return;
+
+        if(client.flush_policy == FlushPolicy::Cork && client.replies.bytes < client.cork_bytes){
+            if(!client.corked){
+                client.corked = true;
+                m_corked.push_back(fd);
+            }
+            return;
+        }
 
+        flush_client(fd);
+    }
 
-            // std::cout << "Command To be Executed\n";
-            std::string response = execute_command(command);
-            // std::cout << "Command Executed\n";
-            send_response(fd, response);            
+    // io_uring and threaded I/O write once after the batch, plain epoll writes right away
+    void flush_client(int fd){
+        if(m_backend == Backend::Uring || m_io_threads){
+            m_pending_sends.push_back(fd);
+        }else{
+            write_to_client(fd);
         }
     }
 
-    std::string execute_command(const std::string& command){
-        std::istringstream iss(command);
-        std::string cmd;
-        iss >> cmd;
-        for(auto& c: cmd) c = std::toupper(c);
-        
-        if (cmd == "SET"){
-            std::string key, value;
-            iss >> key >> value;
-
-            if(!key.empty() && !value.empty()){
-                //Using unordered_map
-                {
-                    // m_string_cache[key] = value;
-                }
-                
-                setString(key, value);
-                // std::cout << "STRING SET\n";
-                return "OK\n";
+    // corked replies never wait past the current event loop iteration
+    void flush_corked_clients(){
+        for(int fd: m_corked){
+            auto it = m_clients.find(fd);
+            if(it == m_clients.end() || !it->second.corked) continue;
+
+            it->second.corked = false;
+            flush_client(fd);
+        }
+        m_corked.clear();
+    }
+
+    // returns false if the client was closed while flushing
+    bool process_complete_commands(int fd){
+        auto& client = m_clients[fd];
+        while(readSize(client.buffer) > 0){
+            size_t size = readSize(client.buffer);
+            long parsed = parse_command(client, readData(client.buffer), size, m_argv);
+            if(parsed == 0) break;
+            if(parsed < 0){
+                // nothing after a malformed header can be trusted, drop the buffered input
+                reply_error(client, "ERR Protocol error");
+                consumeRead(client.buffer, size);
+                break;
             }
             
-            std::cout << "Wrong Args";
-            return "ERR Wrong Number of Arguments\n";
-            
-        }else if (cmd == "GET"){
-            std::string key;
-            iss >> key;
-            if(!key.empty()){
-
-                //Using unordered_map
-                {    
-                    // auto it = m_string_cache.find(key);
-                    // if (it != m_string_cache.end()){
-                    //     return it->second + "\n";
-                    // }
-                    // return "-1\n";
-                }
-                        
-                //using custom stringHash
-                const char * val = getString(key);
-                if(val == nullptr){
-                    return "-1\n";
-                }
+            // the arguments are views into the read buffer, consume it only once the command has run
+            execute_command(m_argv, client);
+            consumeRead(client.buffer, parsed);
+
+            if(m_backend == Backend::Epoll && flush_due(client)){
+                if(!write_to_client(fd)) return false;
+            }
+        }
+        return true;
+    }
+
+    // parses the command at the front of data into argv
+    // returns the bytes it spans, 0 while it is incomplete, -1 on a protocol error
+    long parse_command(ClientState& client, const char* data, size_t size, std::vector<std::string_view>& argv){
+        if(client.protocol == Protocol::Unknown){
+            client.protocol = data[0] == '*' ? Protocol::Resp2 : Protocol::Text;
+        }
+
+        if(client.protocol != Protocol::Text && data[0] == '*'){
+            return parseRespCommand(data, size, argv);
+        }
 
-                std::string result(val);
-                result.append("\n");
-                return result;
+        // text protocol, RESP connections also accept inline commands
+        // a line split across reads is only rescanned from where the last read ended
+        if(client.scanned > 0 && findNewline(data, client.scanned, size) == size){
+            client.scanned = size;
+            return 0;
+        }
+
+        size_t line_len;
+        if(!tokenizeLine(data, size, argv, line_len)){
+            client.scanned = size;
+            return 0;
+        }
+        client.scanned = 0;
+        return (long)(line_len + 1);
+    }
 
+    // threaded I/O: the helpers read and parse every readable client, then this thread
+    // runs the commands in order, nothing but the executor touches the tables
+    void read_batch_threaded(){
+        for(int fd: m_read_again) m_read_jobs.push_back(fd);
+        m_read_again.clear();
+        if(m_read_jobs.empty()) return;
+
+        std::sort(m_read_jobs.begin(), m_read_jobs.end());
+        m_read_jobs.erase(std::unique(m_read_jobs.begin(), m_read_jobs.end()), m_read_jobs.end());
+        collect_io_jobs(m_read_jobs);
+        m_read_jobs.clear();
+
+        m_io_threads->run([this](size_t share){
+            for(size_t i = share; i < m_io_jobs.size(); i += m_io_threads->size()){
+                ClientState& client = *m_io_jobs[i].client;
+                client.io_status = read_available(m_io_jobs[i].fd, client);
+                parse_commands(client, m_share_argv[share]);
             }
-            return "ERR Wrong Number of Arguments\n";
-        }else if (cmd == "DEL"){
-            std::string key;
-            iss >> key;
-            if(!key.empty()){
-                // int deleted = m_string_cache.erase(key); 
-                // return std::to_string(deleted) + "\n";
+        });
 
-                bool deleted = delKey(key);
+        for(const IoJob& job: m_io_jobs){
+            execute_parsed(*job.client);
 
-                if(deleted){
-                    return "1\n";
-                }
-                return "0\n";
-            }
-            return "ERR Wrong Number of Arguments\n";
-        }else if (cmd == "KEYS"){
-            // std::string result;
-            // for(auto&it: m_string_cache){
-            //     result.append(it.first);
-            //     result.append(" ");
-            // }
-            // result.append("\n");
-
-            std::string result = getKeys();
-            result.append("\n");
-            return result;
-        }else if (cmd == "LSET"){
-            std::string key;
-            // std::deque<std::string> values;
-            std::string value;
-            
-            iss >> key;
-            
-            // while(iss >> value){
-            //     values.push_back(value);
-            //     value.clear();
-            // }
-
-            // if(!key.empty() && !values.empty()){
-            //     m_list_cache[key] = values;
-            //     return "OK\n";
-            // }
-            
-            
-            if(!key.empty()){
+            if(job.client->io_status == IoStatus::Closed){
+                cleanup_client(job.fd);
+                continue;
+            }
+            if(job.client->io_status == IoStatus::Pending) m_read_again.push_back(job.fd);
+            finish_read_batch(job.fd);
+        }
+    }
 
-                while(iss >> value){
-                    if (value.empty()){break;}
-                    pushBackList(key, value);
-                }
+    void write_batch_threaded(){
+        if(m_pending_sends.empty()) return;
+
+        std::sort(m_pending_sends.begin(), m_pending_sends.end());
+        m_pending_sends.erase(std::unique(m_pending_sends.begin(), m_pending_sends.end()), m_pending_sends.end());
+        collect_io_jobs(m_pending_sends);
+        m_pending_sends.clear();
 
-                return "OK\n";
+        m_io_threads->run([this](size_t share){
+            for(size_t i = share; i < m_io_jobs.size(); i += m_io_threads->size()){
+                m_io_jobs[i].client->io_status = write_replies(m_io_jobs[i].fd, *m_io_jobs[i].client);
             }
+        });
 
+        for(const IoJob& job: m_io_jobs){
+            finish_write(job.fd, job.client->io_status);
+        }
+    }
 
+    // clients may have been closed since their fd was queued
+    void collect_io_jobs(const std::vector<int>& fds){
+        m_io_jobs.clear();
+        for(int fd: fds){
+            auto it = m_clients.find(fd);
+            if(it != m_clients.end()) m_io_jobs.push_back({fd, &it->second});
+        }
+    }
 
-            return "ERR Wrong Number of Arguments\n";
+    // runs on an I/O thread, touches nothing but the client
+    IoStatus read_available(int fd, ClientState& client){
+        size_t total = 0;
+        while(total < READ_BATCH_LIMIT){
+            size_t space;
+            char* buffer = readSpace(client.buffer, space);
+            ssize_t bytes = read(fd, buffer, space);
 
-        }else if (cmd == "LGET"){
+            if(bytes > 0){
+                commitRead(client.buffer, bytes);
+                total += bytes;
+            }else if(bytes == 0){
+                std::cout << "Client " << fd << " Disconnected\n";
+                return IoStatus::Closed;
+            }else if(errno == EAGAIN || errno == EWOULDBLOCK){
+                break;
+            }else{
+                perror("read");
+                return IoStatus::Closed;
+            }
+        }
+        return total < READ_BATCH_LIMIT ? IoStatus::Done : IoStatus::Pending;
+    }
 
+    // runs on an I/O thread, argv is the thread's scratch vector
+    void parse_commands(ClientState& client, std::vector<std::string_view>& argv){
+        const char* data = readData(client.buffer);
+        size_t size = readSize(client.buffer);
+        size_t pos = 0;
+
+        while(pos < size){
+            long parsed = parse_command(client, data + pos, size - pos, argv);
+            if(parsed == 0) break;
+            if(parsed < 0){
+                client.parsed.push_back({0, size - pos, true});
+                break;
+            }
 
+            client.parsed_argv.insert(client.parsed_argv.end(), argv.begin(), argv.end());
+            client.parsed.push_back({argv.size(), (size_t) parsed, false});
+            pos += parsed;
+        }
+    }
 
-            std::string key;
-            std::string value;
-            
-            
-            {
-            // if (!key.empty()){
-            //     iss >> value;
-            //     if(!value.empty()){
+    void execute_parsed(ClientState& client){
+        size_t arg = 0;
+        size_t consumed = 0;
+        for(const ParsedCommand& command: client.parsed){
+            if(command.protocol_error){
+                reply_error(client, "ERR Protocol error");
+            }else{
+                execute_command(CommandArgs(client.parsed_argv.data() + arg, command.argc), client);
+            }
+            arg += command.argc;
+            consumed += command.bytes;
+        }
 
-            //         int v = std::stoi(value);
+        // the arguments were views into the read buffer, it is only consumed now
+        if(consumed > 0) consumeRead(client.buffer, consumed);
+        client.parsed.clear();
+        client.parsed_argv.clear();
+    }
 
-            //         if (v > m_list_cache[key].size()-1){
-            //             return "ERR Index Out of Bounds\n";
-            //         }
+    using CommandArgs = std::span<const std::string_view>;
 
-            //         std::string result = m_list_cache[key].at(v);
-            //         result.append("\n");
-            //         return result;
-                    
-            //     }
+    using CommandHandler = void (redisServer::*)(CommandArgs, ClientState&);
 
-            //     std::string result;
-            //     for(std::string& v: m_list_cache[key]){
-            //         result.append(v);
-            //         result.append(" ");
-            //     }
-            //     result.append("\n");
-            //     std::cout << result << "\n";
-            //     return result;
-            // }
+    // where a command runs when the keyspace is sharded
+    enum class Route{
+        Local,      // connection state or no keys, runs on the client's reactor
+        Key,        // runs on the shard owning argv[1]
+        AllShards   // the handler fans out itself, see gather_shards
+    };
+
+    struct CommandSpec{
+        std::string_view name;
+        CommandHandler handler;
+        int min_args;       // including the command name
+        int max_args;       // -1 when variadic
+        Route route;
+    };
+
+    // argv[0] is the command name, every argument is a view into the read buffer
+    void execute_command(CommandArgs argv, ClientState& client){
+        static constexpr CommandSpec commands[] = {
+            {"SET",         &redisServer::cmd_set,          3, 3,   Route::Key},
+            {"GET",         &redisServer::cmd_get,          2, 2,   Route::Key},
+            {"DEL",         &redisServer::cmd_del,          2, 2,   Route::Key},
+            {"APPEND",      &redisServer::cmd_append,       3, 3,   Route::Key},
+            {"KEYS",        &redisServer::cmd_keys,         1, 1,   Route::AllShards},
+            {"LSET",        &redisServer::cmd_lpushback,    2, -1,  Route::Key},
+            {"LGET",        &redisServer::cmd_lget,         2, 3,   Route::Key},
+            {"LDEL",        &redisServer::cmd_ldel,         2, 3,   Route::Key},
+            {"LPUSHBACK",   &redisServer::cmd_lpushback,    2, -1,  Route::Key},
+            {"LPOPBACK",    &redisServer::cmd_lpopback,     2, 2,   Route::Key},
+            {"LPUSHFRONT",  &redisServer::cmd_lpushfront,   2, -1,  Route::Key},
+            {"LPOPFRONT",   &redisServer::cmd_lpopfront,    2, 2,   Route::Key},
+            {"LEMPTY",      &redisServer::cmd_lempty,       2, 2,   Route::Key},
+            {"LKEYS",       &redisServer::cmd_lkeys,        1, 1,   Route::AllShards},
+            {"STORE",       &redisServer::cmd_store,        1, 1,   Route::AllShards},
+            {"SLABS",       &redisServer::cmd_slabs,        1, 1,   Route::AllShards},
+            {"LOAD",        &redisServer::cmd_load,         1, 1,   Route::Local},
+            {"FLUSHMODE",   &redisServer::cmd_flushmode,    2, 3,   Route::Local},
+            {"PING",        &redisServer::cmd_ping,         1, 2,   Route::Local},
+            {"ECHO",        &redisServer::cmd_echo,         2, 2,   Route::Local},
+            {"HELLO",       &redisServer::cmd_hello,        1, 2,   Route::Local},
+        };
+        static constexpr DispatchTable table = buildDispatchTable(commands);
+
+        int index = argv.empty() ? -1 : lookupCommand(table, argv[0]);
+        if(index < 0 || !equalsIgnoreCase(argv[0], commands[index].name)){
+            reply_error(client, "ERR Invalid Command");
+            return;
+        }
 
+        const CommandSpec& spec = commands[index];
+        int argc = (int) argv.size();
+        if(argc < spec.min_args || (spec.max_args >= 0 && argc > spec.max_args)){
+            reply_error(client, "ERR Wrong Number of Arguments");
+            return;
+        }
+
+        if(m_shards == nullptr || spec.route == Route::AllShards){
+            (this->*spec.handler)(argv, client);
+            return;
+        }
+
+        size_t owner = spec.route == Route::Key ? key_shard(argv[1]) : m_shard;
+        if(owner == m_shard){
+            run_in_order(spec.handler, argv, client);
+        }else{
+            forward_command(owner, spec.handler, argv, client);
+        }
+    }
+
+    // runs a command here, behind any replies other shards still owe this client
+    void run_in_order(CommandHandler handler, CommandArgs argv, ClientState& client){
+        if(client.reply_slots.empty()){
+            (this->*handler)(argv, client);
+            return;
+        }
+
+        WriteChain earlier = client.replies;
+        client.replies = WriteChain{};
+        (this->*handler)(argv, client);
+
+        ReplySlot& slot = client.reply_slots.emplace_back();
+        client.reply_seq++;
+        drainChain(client.replies, slot.bytes);
+        slot.ready = true;
+        client.replies = earlier;
+    }
+
+    // the arguments are copied, the read buffer is consumed before the owner gets to them
+    void forward_command(size_t owner, CommandHandler handler, CommandArgs argv, ClientState& client){
+        uint64_t seq = reserve_reply(client);
+        std::vector<std::string> args(argv.begin(), argv.end());
+
+        submit_to(owner, [origin = m_shard, fd = client.fd, id = client.id, seq, handler,
+                          protocol = client.protocol, args = std::move(args)](redisServer& shard){
+            std::string reply = shard.run_remote(handler, args, protocol);
+            shard.submit_to(origin, [fd, id, seq, reply = std::move(reply)](redisServer& home) mutable{
+                home.complete_reply(fd, id, seq, std::move(reply));
+            });
+        });
+    }
+
+    // runs on the owning shard, the reply is encoded for the client's protocol
+    std::string run_remote(CommandHandler handler, const std::vector<std::string>& args, Protocol protocol){
+        m_remote_argv.assign(args.begin(), args.end());
+        m_remote_client.protocol = protocol;
+        (this->*handler)(m_remote_argv, m_remote_client);
+
+        std::string reply;
+        drainChain(m_remote_client.replies, reply);
+        return reply;
+    }
+
+    size_t key_shard(std::string_view key){
+        return shardOf(hashKey(key), m_shards->count);
+    }
+
+    uint64_t reserve_reply(ClientState& client){
+        client.reply_slots.emplace_back();
+        return client.reply_seq++;
+    }
+
+    // fills a reserved slot and queues every reply that is now in order
+    void complete_reply(int fd, uint64_t id, uint64_t seq, std::string reply){
+        auto it = m_clients.find(fd);
+        if(it == m_clients.end() || it->second.id != id) return;
+
+        ClientState& client = it->second;
+        uint64_t first = client.reply_seq - client.reply_slots.size();
+        ReplySlot& slot = client.reply_slots[seq - first];
+        slot.bytes = std::move(reply);
+        slot.ready = true;
+
+        while(!client.reply_slots.empty() && client.reply_slots.front().ready){
+            send_response(client, client.reply_slots.front().bytes);
+            client.reply_slots.pop_front();
+        }
+        finish_read_batch(fd);
+    }
+
+    using ShardCollect = void (redisServer::*)(std::vector<std::string>&);
+    using ShardFinish = void (redisServer::*)(std::vector<std::string>&, ClientState&);
+
+    struct Gather{
+        std::vector<std::string> parts;
+        size_t waiting;
+    };
+
+    // runs collect on every shard, then finish here on all of the collected parts
+    void gather_shards(ClientState& client, ShardCollect collect, ShardFinish finish){
+        if(m_shards == nullptr){
+            std::vector<std::string> parts;
+            (this->*collect)(parts);
+            (this->*finish)(parts, client);
+            return;
+        }
+
+        uint64_t seq = reserve_reply(client);
+        auto gather = std::make_shared<Gather>();
+        gather->waiting = m_shards->count - 1;
+        (this->*collect)(gather->parts);
+
+        for(size_t shard = 0; shard < m_shards->count; ++shard){
+            if(shard == m_shard) continue;
+
+            submit_to(shard, [origin = m_shard, fd = client.fd, id = client.id, seq, protocol = client.protocol,
+                              gather, collect, finish](redisServer& owner){
+                std::vector<std::string> parts;
+                (owner.*collect)(parts);
+
+                owner.submit_to(origin, [fd, id, seq, protocol, gather, finish, parts = std::move(parts)](redisServer& home) mutable{
+                    for(auto& part: parts) gather->parts.push_back(std::move(part));
+                    if(--gather->waiting > 0) return;
+
+                    home.m_remote_client.protocol = protocol;
+                    (home.*finish)(gather->parts, home.m_remote_client);
+                    std::string reply;
+                    drainChain(home.m_remote_client.replies, reply);
+                    home.complete_reply(fd, id, seq, std::move(reply));
+                });
+            });
+        }
+    }
+
+    // queues are never waited on, a full one spills into the outbox until the next flush
+    void submit_to(size_t shard, ShardTask task){
+        if(!m_outbox[shard].empty() || !m_shards->queue(m_shard, shard).push(std::move(task))){
+            m_outbox[shard].push_back(std::move(task));
+        }
+        m_wake[shard] = true;
+    }
+
+    void drain_shard_inbox(){
+        ShardTask task;
+        for(size_t from = 0; from < m_shards->count; ++from){
+            if(from == m_shard) continue;
+            auto& queue = m_shards->queue(from, m_shard);
+            while(queue.pop(task)) task(*this);
+        }
+        task = nullptr;
+    }
+
+    // one eventfd write per woken shard per event loop iteration
+    void flush_shard_messages(){
+        if(m_shards == nullptr) return;
+
+        for(size_t shard = 0; shard < m_shards->count; ++shard){
+            auto& outbox = m_outbox[shard];
+            auto& queue = m_shards->queue(m_shard, shard);
+            while(!outbox.empty() && queue.push(std::move(outbox.front()))){
+                outbox.pop_front();
+                m_wake[shard] = true;
             }
-            
-            
-            iss >> key;
-            iss >> value;
-            
-            try{
-                
-                if(!key.empty() && !value.empty()){
-                    //add error check here to know if the value is int, if not call getList instead of getListR
-                    return getListR(key, std::stoi(value));
-                }
-                
-                if(!key.empty()){
-                    return getList(key);
-                }
-            }catch(std::exception &e){
-                std::cout << e.what();
-                exit(EXIT_FAILURE); 
-            }
-            return "ERR Wrong Number of Arguments\n";
-
-        }else if (cmd == "LDEL"){
-            std::string key, index;
-            iss >> key;
-            if(!key.empty()){
-                // int deleted = m_list_cache.erase(key);
-                // return std::to_string(deleted) + "\n";
-                bool result;
-                if(iss >> index){
-                    result = delListR(key, std::stoi(index)); // Randomly delete value at index in key list 
-                }else{
-                    result = delList(key); // Delete entire list
-                }
 
-                if(result){
-                    return "1\n";
-                }else{
-                    return "0\n";
-                }
+            if(m_wake[shard]){
+                uint64_t one = 1;
+                if(write(m_shards->wake_fds[shard], &one, sizeof(one)) < 0 && errno != EAGAIN) perror("write eventfd");
+                m_wake[shard] = false;
             }
-            return "ERR Wrong Number of Arguments\n";
-        }else if (cmd == "LPUSHBACK"){
-            std::string key;
-            iss >> key;
+        }
+    }
 
-            std::string value;
-            if(!key.empty()){
-                while(iss >> value){
-                    // m_list_cache[key].push_back(value);
-                    // value.clear();
+    bool shard_backlog() const{
+        for(const auto& outbox: m_outbox){
+            if(!outbox.empty()) return true;
+        }
+        return false;
+    }
 
-                    pushBackList(key, value);
-                    value.clear();
-                }
-                return "OK\n";
-            }
-
-            return "ERR Wrong Number of Arguments\n";
-        }else if (cmd == "LPOPBACK"){
-            std::string key;
-            iss >> key;
-            if(!key.empty()){
-                // std::string value;
-                // std::string result = "";
-                // while(iss >> value){
-                    
-                //     int v = std::stoi(value);
-                //     if(v > m_list_cache[key].size()-1){
-                //         return "ERR Index Out of Bounds\n";
-                //     }
-
-                //     result.append(m_list_cache[key].at(v));
-                //     m_list_cache[key].erase(m_list_cache[key].begin() + v);
-                //     result.append(" ");
-
-                // }
-                // result.append("\n");
-                // return result;
-
-                std::string result = popBackList(key);
-
-                result.append("\n");
-                return result;
-            }
-            return "ERR Wrong Number of Arguments\n";
-        }else if (cmd == "LPUSHFRONT"){
-            std::string key;
-            iss >> key;
-
-            std::string value;
-            if(!key.empty()){
-                while(iss >> value){
-                    // m_list_cache[key].push_back(value);
-                    // value.clear();
-
-                    pushFrontList(key, value);
-                    value.clear();
-                }
-                return "OK\n";
-            }
-
-            return "ERR Wrong Number of Arguments\n";
-        }else if (cmd == "LPOPFRONT"){
-            std::string key;
-            iss >> key;
-            if(!key.empty()){
-                // std::string value;
-                // std::string result = "";
-                // while(iss >> value){
-                    
-                //     int v = std::stoi(value);
-                //     if(v > m_list_cache[key].size()-1){
-                //         return "ERR Index Out of Bounds\n";
-                //     }
-
-                //     result.append(m_list_cache[key].at(v));
-                //     m_list_cache[key].erase(m_list_cache[key].begin() + v);
-                //     result.append(" ");
-
-                // }
-                // result.append("\n");
-                // return result;
-
-                std::string result = popFrontList(key);
-
-                result.append("\n");
-                return result;
-            }
-            return "ERR Wrong Number of Arguments\n";
-        }else if (cmd == "LEMPTY"){
-            std::string key;
-            iss >> key;
-            if(!key.empty()){
-                if (m_list_cache[key].empty()){
-                    return "TRUE\n";
-                }else{
-                    return "FALSE\n";
-                }
+    // replies are appended straight to the client's write chain, GET and SET allocate nothing
+    void cmd_set(CommandArgs argv, ClientState& client){
+        if(setString(argv[1], argv[2]) == KeyResult::TooLarge){
+            reply_missing(client, KeyResult::TooLarge);
+            return;
+        }
+        reply_status(client, "OK");
+    }
+
+    void cmd_get(CommandArgs argv, ClientState& client){
+        //using custom stringHash
+        std::string_view val;
+        KeyResult result = getString(argv[1], val);
+        if(result != KeyResult::Found){
+            reply_missing(client, result);
+            return;
+        }
+
+        reply_bulk(client, val);
+    }
+
+    void cmd_del(CommandArgs argv, ClientState& client){
+        reply_integer(client, delKey(argv[1]) ? 1 : 0);
+    }
+
+    void cmd_append(CommandArgs argv, ClientState& client){
+        size_t length;
+        KeyResult result = appendString(argv[1], argv[2], length);
+        if(result != KeyResult::Found){
+            reply_missing(client, result);
+            return;
+        }
+        reply_integer(client, (int64_t) length);
+    }
+
+    void cmd_keys(CommandArgs, ClientState& client){
+        gather_shards(client, &redisServer::collect_keys, &redisServer::finish_array);
+    }
+
+    void collect_keys(std::vector<std::string>& parts){
+        getKeys(m_items, EntryType::String);
+        parts.insert(parts.end(), m_items.begin(), m_items.end());
+    }
+
+    void finish_array(std::vector<std::string>& parts, ClientState& client){
+        m_items.assign(parts.begin(), parts.end());
+        reply_array(client, m_items);
+    }
+
+    // LSET is kept as an alias of LPUSHBACK
+    void cmd_lpushback(CommandArgs argv, ClientState& client){
+        for(size_t i = 2; i < argv.size(); ++i){
+            if(pushBackList(argv[1], argv[i]) == KeyResult::WrongType){
+                reply_missing(client, KeyResult::WrongType);
+                return;
             }
-            return "ERR Wrong Number of Arguments\n";
-        }else if (cmd == "LKEYS"){
-            std::string result;
-            // for(auto& it: m_list_cache){
-            //     result.append(it.first);
-            //     result.append(" ");
-            // }
-            // result.append("\n");
+        }
+        reply_status(client, "OK");
+    }
 
+    void cmd_lpushfront(CommandArgs argv, ClientState& client){
+        for(size_t i = 2; i < argv.size(); ++i){
+            if(pushFrontList(argv[1], argv[i]) == KeyResult::WrongType){
+                reply_missing(client, KeyResult::WrongType);
+                return;
+            }
+        }
+        reply_status(client, "OK");
+    }
 
-            result = getListKeys();
+    void cmd_lget(CommandArgs argv, ClientState& client){
+        if(argv.size() == 3){
+            int64_t list_index;
+            if(!parseInteger(argv[2], list_index)){
+                reply_error(client, "ERR Invalid Index");
+                return;
+            }
 
-            return result;
-        }else if (cmd == "STORE"){
-            
-            rapidjson::StringBuffer s;
-            rapidjson::Writer<rapidjson::StringBuffer> writer(s);
-            
-            writer.StartObject();
-            getSnapDict(writer);
-            getSnapList(writer);
-            writer.EndObject();
-            
-            // std::cout << "STORED" << "\n";
+            std::string_view value;
+            KeyResult result = getListR(argv[1], list_index, value, m_item_bytes);
+            if(result == KeyResult::MissingKey){
+                reply_error(client, "Invalid Key");
+            }else if(result == KeyResult::OutOfRange){
+                reply_error(client, "Index Out of Bounds");
+            }else if(result == KeyResult::WrongType){
+                reply_missing(client, result);
+            }else{
+                reply_bulk(client, value);
+            }
+            return;
+        }
+        
+        KeyResult result = getList(argv[1], m_items, m_item_bytes);
+        if(result != KeyResult::Found){
+            reply_missing(client, result);
+            return;
+        }
+        reply_array(client, m_items);
+    }
 
-            std::ofstream file("Redis Cache");
-            file.clear();
-            file << s.GetString();
-            file.close();
+    void cmd_ldel(CommandArgs argv, ClientState& client){
+        KeyResult result;
+        if(argv.size() == 3){
+            int64_t list_index;
+            if(!parseInteger(argv[2], list_index)){
+                reply_error(client, "ERR Invalid Index");
+                return;
+            }
+            result = delListR(argv[1], list_index); // Randomly delete value at index in key list 
+        }else{
+            result = delList(argv[1]); // Delete entire list
+        }
 
-            return "OK\n";
+        if(result == KeyResult::WrongType){
+            reply_missing(client, result);
+            return;
         }
-        else if (cmd == "LOAD"){
+        reply_integer(client, result == KeyResult::Found ? 1 : 0);
+    }
 
-            FILE* fp = fopen("Redis Cache", "r");
+    void cmd_lpopback(CommandArgs argv, ClientState& client){
+        std::string value;
+        KeyResult result = popBackList(argv[1], value);
+        if(result == KeyResult::Found){
+            reply_bulk(client, value);
+        }else{
+            reply_missing(client, result);
+        }
+    }
 
-            if(!fp){
-                return "ERR Unable To Open Cache File\n";
+    void cmd_lpopfront(CommandArgs argv, ClientState& client){
+        std::string value;
+        KeyResult result = popFrontList(argv[1], value);
+        if(result == KeyResult::Found){
+            reply_bulk(client, value);
+        }else{
+            reply_missing(client, result);
+        }
+    }
+
+    void cmd_lempty(CommandArgs argv, ClientState& client){
+        // a missing key is an empty list, lists that run empty are removed
+        size_t size;
+        if(listSize(argv[1], size) == KeyResult::WrongType){
+            reply_missing(client, KeyResult::WrongType);
+            return;
+        }
+        reply_bool(client, size == 0);
+    }
+
+    void cmd_lkeys(CommandArgs, ClientState& client){
+        gather_shards(client, &redisServer::collect_list_keys, &redisServer::finish_array);
+    }
+
+    void collect_list_keys(std::vector<std::string>& parts){
+        getListKeys(m_items);
+        parts.insert(parts.end(), m_items.begin(), m_items.end());
+    }
+
+    void cmd_store(CommandArgs, ClientState& client){
+        gather_shards(client, &redisServer::collect_snapshot, &redisServer::finish_store);
+    }
+
+    // every shard writes its own keys as one JSON object
+    void collect_snapshot(std::vector<std::string>& parts){
+        rapidjson::StringBuffer s;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(s);
+
+        writer.StartObject();
+        getSnapDict(writer);
+        getSnapList(writer);
+        writer.EndObject();
+
+        parts.emplace_back(s.GetString(), s.GetSize());
+    }
+
+    // the shard objects are merged into the single object LOAD reads
+    void finish_store(std::vector<std::string>& parts, ClientState& client){
+        std::ofstream file("Redis Cache");
+        file.clear();
+        file << '{';
+        bool first = true;
+        for(const auto& part: parts){
+            if(part.size() <= 2) continue;
+            if(!first) file << ',';
+            file.write(part.data() + 1, part.size() - 2);
+            first = false;
+        }
+        file << '}';
+        file.close();
+
+        reply_status(client, "OK");
+    }
+
+    // per size class usage and fragmentation of every shard's slab allocator
+    void cmd_slabs(CommandArgs, ClientState& client){
+        gather_shards(client, &redisServer::collect_slabs, &redisServer::finish_slabs);
+    }
+
+    void collect_slabs(std::vector<std::string>& parts){
+        std::string report = "shard " + std::to_string(m_shard) + "\n";
+        Slabs.report(report);
+        parts.push_back(std::move(report));
+    }
+
+    // shards answer in any order, every report starts with "shard <n>"
+    void finish_slabs(std::vector<std::string>& parts, ClientState& client){
+        std::sort(parts.begin(), parts.end(), [](const std::string& a, const std::string& b){
+            return std::stoul(a.substr(6)) < std::stoul(b.substr(6));
+        });
+        std::string report;
+        for(const auto& part: parts) report += part;
+        reply_bulk(client, report);
+    }
+
+    void cmd_load(CommandArgs, ClientState& client){
+        FILE* fp = fopen("Redis Cache", "r");
+
+        if(!fp){
+            reply_error(client, "ERR Unable To Open Cache File");
+            return;
+        }
+
+        char buffer[65536];
+
+        rapidjson::FileReadStream stream (fp, buffer, sizeof(buffer));
+
+        rapidjson::Reader reader;
+        
+        JsonReader handler;
+
+        if(!reader.Parse(stream, handler)){
+            fclose(fp);
+            reply_error(client, "ERR Cannot Parse Json");
+            return;
+        }
+
+        fclose(fp);
+
+        if(m_shards == nullptr){
+            load_snapshot(handler.kvMap, handler.kaMap);
+            reply_status(client, "OK");
+            return;
+        }
+
+        // every key is loaded by the shard that owns it, later commands from this client
+        // reach those shards through the same queues and so see the loaded keys
+        std::vector<SnapshotPart> parts(m_shards->count);
+        for(auto& [key, value] : handler.kvMap){
+            parts[key_shard(key)].strings.emplace(key, std::move(value));
+        }
+        for(auto& [key, value] : handler.kaMap){
+            parts[key_shard(key)].lists.emplace(key, std::move(value));
+        }
+
+        for(size_t shard = 0; shard < m_shards->count; ++shard){
+            if(shard == m_shard){
+                load_snapshot(parts[shard].strings, parts[shard].lists);
+                continue;
             }
+            submit_to(shard, [part = std::move(parts[shard])](redisServer& owner){
+                owner.load_snapshot(part.strings, part.lists);
+            });
+        }
+        reply_status(client, "OK");
+    }
 
-            char buffer[65536];
+    struct SnapshotPart{
+        std::unordered_map<std::string, std::string> strings;
+        std::unordered_map<std::string, std::vector<std::string>> lists;
+    };
 
-            rapidjson::FileReadStream stream (fp, buffer, sizeof(buffer));
+    void load_snapshot(const std::unordered_map<std::string, std::string>& strings,
+                       const std::unordered_map<std::string, std::vector<std::string>>& lists){
+        //convert unorderedmap <String, String> to Dict
+        for(const auto& [key, value] : strings)
+        {
+            setString(key, value);
+        }
 
-            rapidjson::Reader reader;
-            
-            JsonReader handler;
+        //convert unorderedmap <String, Vector<String>> to Lists
+        for(const auto& [key, value] : lists)
+        {
+            delKey(key);
+            for(const auto& item : value)
+            {
+                pushBackList(key, item);
+            }
+        }
+    }
 
-            if(!reader.Parse(stream, handler)){
-                return "ERR Cannot Parse Json\n";
-            }else{
-                //convert unorderedmap <String, String> to Dict
-                
-                for(const auto& [key, value] : handler.kvMap)
-                {
-                    setString(key, value);
-                }
+    void cmd_flushmode(CommandArgs argv, ClientState& client){
+        std::string_view bytes = argv.size() == 3 ? argv[2] : std::string_view();
+
+        int64_t cork_bytes;
+        if(equalsIgnoreCase(argv[1], "IMMEDIATE")){
+            client.flush_policy = FlushPolicy::Immediate;
+        }else if(equalsIgnoreCase(argv[1], "BATCH")){
+            client.flush_policy = FlushPolicy::EndOfBatch;
+        }else if(equalsIgnoreCase(argv[1], "CORK") && parseInteger(bytes, cork_bytes) && cork_bytes >= 0){
+            client.flush_policy = FlushPolicy::Cork;
+            client.cork_bytes = cork_bytes;
+        }else{
+            reply_error(client, "ERR Unknown Flush Mode");
+            return;
+        }
+        reply_status(client, "OK");
+    }
 
-                //convert unorderedmap <String, Vector<String>> to Lists
-                for(const auto& [key, value] : handler.kaMap)
-                {
-                    delList(key);
-                    for(const auto& item : value)
-                    {
-                        pushBackList(key, item);
-                    }
-                }
+    void cmd_ping(CommandArgs argv, ClientState& client){
+        if(argv.size() == 2){
+            reply_bulk(client, argv[1]);
+            return;
+        }
+        reply_status(client, "PONG");
+    }
 
+    void cmd_echo(CommandArgs argv, ClientState& client){
+        reply_bulk(client, argv[1]);
+    }
+
+    // HELLO [2|3] switches a RESP connection between RESP2 and RESP3
+    void cmd_hello(CommandArgs argv, ClientState& client){
+        if(argv.size() == 2){
+            int64_t version;
+            if(!parseInteger(argv[1], version) || version < 2 || version > 3){
+                reply_error(client, "NOPROTO unsupported protocol version");
+                return;
+            }
+            if(client.protocol == Protocol::Text){
+                reply_error(client, "ERR HELLO needs a RESP connection");
+                return;
             }
+            client.protocol = version == 3 ? Protocol::Resp3 : Protocol::Resp2;
+        }
 
-            fclose(fp);
-            return "OK\n";
+        if(client.protocol == Protocol::Text){
+            reply_status(client, "FastCache");
+            return;
         }
-        else if(cmd == "DELALL"){
-            
+
+        bool resp3 = client.protocol == Protocol::Resp3;
+        appendRespHeader(client.replies, resp3 ? '%' : '*', resp3 ? 3 : 6);
+        appendRespBulk(client.replies, "server");
+        appendRespBulk(client.replies, "FastCache");
+        appendRespBulk(client.replies, "version");
+        appendRespBulk(client.replies, "1.0.0");
+        appendRespBulk(client.replies, "proto");
+        appendRespHeader(client.replies, ':', resp3 ? 3 : 2);
+    }
+
+    // every reply goes through these so handlers never care which protocol the client speaks
+    void reply_status(ClientState& client, std::string_view status){
+        if(client.protocol == Protocol::Text){
+            send_response(client, status);
+            send_response(client, "\n");
+            return;
         }
-        return "ERR Invalid Command\n";
+        appendRespLine(client.replies, '+', status);
     }
-   
-    void send_response(int fd, std::string response){
-        auto& client = m_clients[fd];
-        client.write_buffer += response;
-        // std::cout << "Sending Response\n";
-        if(!client.write_buffer.empty()){
-            modify_epoll(fd, EPOLLIN | EPOLLOUT | EPOLLET);
+
+    void reply_error(ClientState& client, std::string_view message){
+        if(client.protocol == Protocol::Text){
+            send_response(client, message);
+            send_response(client, "\n");
+            return;
+        }
+        appendRespLine(client.replies, '-', message);
+    }
+
+    void reply_bulk(ClientState& client, std::string_view value){
+        if(client.protocol == Protocol::Text){
+            send_response(client, value);
+            send_response(client, "\n");
+            return;
+        }
+        appendRespBulk(client.replies, value);
+    }
+
+    void reply_nil(ClientState& client){
+        if(client.protocol == Protocol::Text){
+            send_response(client, "-1\n");
+        }else if(client.protocol == Protocol::Resp3){
+            send_response(client, "_\r\n");
+        }else{
+            send_response(client, "$-1\r\n");
         }
+    }
 
+    void reply_integer(ClientState& client, int64_t value){
+        if(client.protocol == Protocol::Text){
+            char text[24];
+            char* end = std::to_chars(text, text + sizeof(text), value).ptr;
+            *end++ = '\n';
+            send_response(client, std::string_view(text, end - text));
+            return;
+        }
+        appendRespHeader(client.replies, ':', value);
+    }
 
-        if(client.write_buffer.empty()){
-           modify_epoll(fd, EPOLLIN | EPOLLET); 
+    // nil for a missing key, an error for a key of another type or a string past the size limit
+    void reply_missing(ClientState& client, KeyResult result){
+        if(result == KeyResult::WrongType){
+            reply_error(client, "WRONGTYPE Operation against a key holding the wrong kind of value");
+        }else if(result == KeyResult::TooLarge){
+            reply_error(client, "ERR string exceeds maximum allowed size (512MB)");
+        }else{
+            reply_nil(client);
         }
     }
+
+    void reply_bool(ClientState& client, bool value){
+        if(client.protocol == Protocol::Text){
+            send_response(client, value ? "TRUE\n" : "FALSE\n");
+        }else if(client.protocol == Protocol::Resp3){
+            send_response(client, value ? "#t\r\n" : "#f\r\n");
+        }else{
+            reply_integer(client, value ? 1 : 0);
+        }
+    }
+
+    // text clients get the items space separated on one line
+    void reply_array(ClientState& client, const std::vector<std::string_view>& items){
+        if(client.protocol == Protocol::Text){
+            for(auto item: items){
+                send_response(client, item);
+                send_response(client, " ");
+            }
+            send_response(client, "\n");
+            return;
+        }
+
+        appendRespHeader(client.replies, '*', items.size());
+        for(auto item: items){
+            appendRespBulk(client.replies, item);
+        }
+    }
+
+    void send_response(ClientState& client, std::string_view response){
+        // written out according to the client's flush policy, see finish_read_batch
+        appendChain(client.replies, response.data(), response.size());
+    }
    
     void cleanup_client(int fd){
         std::cout << "Clean Up Called\n";
@@ -624,6 +1578,14 @@ class redisServer{
         }
 
         close(fd);
+        release_client_buffers(m_clients[fd]);
         m_clients.erase(fd);
     }
+
+    // segments go back to the pool for the next connection
+    void release_client_buffers(ClientState& client){
+        releaseRead(client.buffer);
+        releaseChain(client.replies);
+        releaseChain(client.inflight);
+    }
 };
\ No newline at end of file
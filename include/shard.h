@@ -0,0 +1,120 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// shared-nothing keyspace partitioning
+// every shard thread owns the keys that hash to it, other shards never touch its tables,
+// they hand it work through one single-producer single-consumer queue per shard pair
+
+
+constexpr size_t SHARD_QUEUE_SIZE = 4096;
+
+
+// bounded ring, push fails instead of blocking when the consumer falls behind
+template<class T>
+class SpscQueue{
+
+    public:
+
+    explicit SpscQueue(size_t capacity = SHARD_QUEUE_SIZE) : m_slots(capacity), m_mask(capacity - 1){}
+
+    // item is only moved from when it was queued
+    bool push(T&& item){
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if(tail - m_head_cache == m_slots.size()){
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if(tail - m_head_cache == m_slots.size()) return false;
+        }
+
+        m_slots[tail & m_mask] = std::move(item);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item){
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if(head == m_tail_cache){
+            m_tail_cache = m_tail.load(std::memory_order_acquire);
+            if(head == m_tail_cache) return false;
+        }
+
+        item = std::move(m_slots[head & m_mask]);
+        m_slots[head & m_mask] = T();
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    private:
+
+    std::vector<T> m_slots;
+    size_t m_mask;
+
+    // consumer side
+    alignas(64) std::atomic<size_t> m_head{0};
+    size_t m_tail_cache = 0;
+
+    // producer side, on its own cache line so the two threads don't fight over it
+    alignas(64) std::atomic<size_t> m_tail{0};
+    size_t m_head_cache = 0;
+};
+
+
+template<class Task>
+struct ShardSet{
+    size_t count;
+    std::vector<std::unique_ptr<SpscQueue<Task>>> queues;   // [from * count + to]
+    std::vector<int> wake_fds;                              // one eventfd per shard
+
+    explicit ShardSet(size_t shards) : count(shards){
+        for(size_t i = 0; i < count * count; ++i){
+            queues.push_back(std::make_unique<SpscQueue<Task>>());
+        }
+
+        for(size_t i = 0; i < count; ++i){
+            int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if(fd < 0){
+                perror("eventfd");
+                exit(EXIT_FAILURE);
+            }
+            wake_fds.push_back(fd);
+        }
+    }
+
+    SpscQueue<Task>& queue(size_t from, size_t to){
+        return *queues[from * count + to];
+    }
+};
+
+
+// the table index uses the low hash bits, shards are picked from the high ones after
+// mixing so a shard's keys still spread over all of its buckets
+inline size_t shardOf(uint64_t key_hash, size_t count){
+    uint64_t hash = key_hash * 0x9E3779B97F4A7C15ull;
+    return (size_t)(((hash >> 32) * count) >> 32);
+}
+
+inline void pinToCore(size_t shard){
+    unsigned cores = std::thread::hardware_concurrency();
+    if(cores == 0) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(shard % cores, &set);
+    // not fatal, the shard still works unpinned
+    if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0){
+        fprintf(stderr, "Unable to pin shard %zu to a core\n", shard);
+    }
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// memcached style size class allocator for keys, values and list nodes
+// chunk sizes grow by 1.25x from 16 bytes, every class carves its chunks out of its own pages
+// and keeps freed ones on a free list, churn keeps reusing the same memory instead of
+// fragmenting the heap, pages are never handed back
+// each shard thread has its own allocator next to its tables, so nothing here is locked
+
+
+constexpr size_t SLAB_PAGE_SIZE = 64 * 1024;
+constexpr size_t SLAB_MIN_CHUNK = 16;
+constexpr size_t SLAB_MAX_CHUNK = SLAB_PAGE_SIZE / 4;    // anything bigger goes straight to malloc
+
+
+class SlabAllocator{
+
+    public:
+
+    SlabAllocator(){
+        for(size_t size = SLAB_MIN_CHUNK; size < SLAB_MAX_CHUNK; size = (size * 5 / 4 + 7) & ~(size_t) 7){
+            m_classes.push_back(SlabClass{size});
+        }
+        m_classes.push_back(SlabClass{SLAB_MAX_CHUNK});
+    }
+
+    ~SlabAllocator(){
+        for(char* page: m_pages) std::free(page);
+    }
+
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    void* allocate(size_t size){
+        if(size > SLAB_MAX_CHUNK){
+            m_large_bytes += size;
+            ++m_large_count;
+            return checked(std::malloc(size));
+        }
+
+        SlabClass& c = m_classes[class_of(size)];
+        c.requested += size;
+        ++c.used;
+
+        if(c.free_list != nullptr){
+            FreeChunk* chunk = c.free_list;
+            c.free_list = chunk->next;
+            return chunk;
+        }
+
+        // chunks are cut from the page as they are needed, untouched pages stay unbacked
+        if(c.carve_left == 0){
+            char* page = static_cast<char*>(checked(std::malloc(SLAB_PAGE_SIZE)));
+            m_pages.push_back(page);
+            ++c.pages;
+            c.carve = page;
+            c.carve_left = SLAB_PAGE_SIZE / c.chunk_size;
+        }
+        void* chunk = c.carve;
+        c.carve += c.chunk_size;
+        --c.carve_left;
+        return chunk;
+    }
+
+    // what allocate(size) really hands out, callers that track a capacity can use all of it
+    size_t chunk_size(size_t size) const{
+        return size > SLAB_MAX_CHUNK ? size : m_classes[class_of(size)].chunk_size;
+    }
+
+    // capacity gets the whole chunk, only size counts as requested so rounding shows up as internal waste
+    void* allocate(size_t size, size_t& capacity){
+        capacity = chunk_size(size);
+        return allocate(size);
+    }
+
+    // size has to be the one the chunk was allocated with
+    void deallocate(void* p, size_t size){
+        deallocate(p, size, size);
+    }
+
+    // a chunk taken with a capacity, size is still the one it was requested with
+    void deallocate(void* p, size_t capacity, size_t size){
+        if(p == nullptr) return;
+        if(capacity > SLAB_MAX_CHUNK){
+            m_large_bytes -= capacity;
+            --m_large_count;
+            std::free(p);
+            return;
+        }
+
+        SlabClass& c = m_classes[class_of(capacity)];
+        c.requested -= size;
+        --c.used;
+
+        FreeChunk* chunk = static_cast<FreeChunk*>(p);
+        chunk->next = c.free_list;
+        c.free_list = chunk;
+    }
+
+    // one line per class that owns pages, then the totals
+    // internal is lost to rounding requests up to the chunk size, free is chunks not handed out
+    void report(std::string& out) const{
+        char line[192];
+        size_t pages = 0, requested = 0;
+
+        for(size_t i = 0; i < m_classes.size(); ++i){
+            const SlabClass& c = m_classes[i];
+            if(c.pages == 0) continue;
+
+            size_t chunks = c.pages * (SLAB_PAGE_SIZE / c.chunk_size);
+            size_t used_bytes = c.used * c.chunk_size;
+            snprintf(line, sizeof(line), "class %zu chunk %zu pages %zu used %zu/%zu requested %zu internal %.1f%% free %.1f%%\n",
+                     i, c.chunk_size, c.pages, c.used, chunks, c.requested,
+                     percent(used_bytes - c.requested, used_bytes), percent(chunks - c.used, chunks));
+            out += line;
+
+            pages += c.pages;
+            requested += c.requested;
+        }
+
+        snprintf(line, sizeof(line), "total pages %zu bytes %zu requested %zu fragmentation %.1f%% large %zu bytes %zu\n",
+                 pages, pages * SLAB_PAGE_SIZE, requested, percent(pages * SLAB_PAGE_SIZE - requested, pages * SLAB_PAGE_SIZE),
+                 m_large_count, m_large_bytes);
+        out += line;
+    }
+
+    private:
+
+    struct FreeChunk{
+        FreeChunk* next;
+    };
+
+    struct SlabClass{
+        size_t chunk_size;
+        FreeChunk* free_list = nullptr;
+        char* carve = nullptr;          // next unused chunk of the newest page
+        size_t carve_left = 0;
+        size_t pages = 0;
+        size_t used = 0;                // chunks handed out
+        size_t requested = 0;           // bytes asked for by the chunks handed out
+    };
+
+    std::vector<SlabClass> m_classes;
+    std::vector<char*> m_pages;
+    size_t m_large_count = 0;
+    size_t m_large_bytes = 0;
+
+    // smallest class whose chunks fit size, there are only a few dozen classes
+    size_t class_of(size_t size) const{
+        size_t low = 0, high = m_classes.size() - 1;
+        while(low < high){
+            size_t mid = (low + high) / 2;
+            if(m_classes[mid].chunk_size < size) low = mid + 1;
+            else high = mid;
+        }
+        return low;
+    }
+
+    static void* checked(void* memory){
+        if(memory == nullptr){
+            perror("Slab Allocation Failure");
+            exit(EXIT_FAILURE);
+        }
+        return memory;
+    }
+
+    static double percent(size_t part, size_t whole){
+        return whole == 0 ? 0.0 : 100.0 * part / whole;
+    }
+};
+
+// owned by the shard thread like its tables
+inline thread_local SlabAllocator Slabs;
+
+#endif
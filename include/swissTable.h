@@ -0,0 +1,319 @@
+#ifndef SWISSTABLE_H
+#define SWISSTABLE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// open addressing table shared by every keyed structure, header only
+// Swiss table layout: besides the slot array every table keeps one control byte per slot,
+// 0 for empty, 1 for deleted, or 0x80 plus 7 bits of the key's hash when full
+// lookups compare a whole 16 slot group of control bytes at once and only touch a slot
+// when its 7 hash bits match
+//
+// Slot is stored by value, a small struct keeps keys inline, a pointer makes storage indirect
+// Policy supplies, all at compile time:
+//   Key                            what lookups pass in, e.g. std::string_view
+//   hash(slot)                     the slot's full key hash, stored or recomputed
+//   matches(slot, key, hash)       key equality, the 7 control bits already matched
+//   release(slot)                  frees what a slot owns when it is erased
+//   Probe                          next group to visit, see TriangularProbe and LinearProbe
+//   MAX_LOAD_PERCENT               full slots plus tombstones allowed before growing
+//   REHASH_STEP                    slots migrated by every operation while growing
+
+
+constexpr uint8_t CTRL_EMPTY = 0x00;
+constexpr uint8_t CTRL_DELETED = 0x01;
+constexpr size_t GROUP_WIDTH = 16;
+
+inline uint8_t ctrlHash(uint64_t hash){
+    return 0x80 | (hash & 0x7F);
+}
+
+inline bool ctrlFull(uint8_t ctrl){
+    return ctrl & 0x80;
+}
+
+#ifdef __SSE2__
+
+// bit i is set when control byte i of the group equals value
+inline uint32_t matchGroup(const uint8_t* group, uint8_t value){
+    __m128i ctrl = _mm_loadu_si128((const __m128i*) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) value)));
+}
+
+// empty or deleted slots, the only control bytes without the high bit
+inline uint32_t matchFree(const uint8_t* group){
+    __m128i ctrl = _mm_loadu_si128((const __m128i*) group);
+    return ~(uint32_t) _mm_movemask_epi8(ctrl) & 0xFFFF;
+}
+
+#else
+
+inline uint32_t matchGroup(const uint8_t* group, uint8_t value){
+    uint32_t mask = 0;
+    for(size_t i = 0; i < GROUP_WIDTH; ++i){
+        if(group[i] == value) mask |= 1u << i;
+    }
+    return mask;
+}
+
+inline uint32_t matchFree(const uint8_t* group){
+    uint32_t mask = 0;
+    for(size_t i = 0; i < GROUP_WIDTH; ++i){
+        if(!ctrlFull(group[i])) mask |= 1u << i;
+    }
+    return mask;
+}
+
+#endif
+
+
+// visits every group of a power of two table, keys that collide spread out quickly
+struct TriangularProbe{
+    static size_t next(size_t group, size_t step, size_t group_mask){
+        return (group + step) & group_mask;
+    }
+};
+
+// neighbouring groups, better locality for tables that stay sparse
+struct LinearProbe{
+    static size_t next(size_t group, size_t, size_t group_mask){
+        return (group + 1) & group_mask;
+    }
+};
+
+
+// zeroed, calloc gets large tables straight from fresh pages instead of clearing them
+// while the event loop waits, zeroed control bytes are all empty
+inline void* allocateTableMemory(size_t count, size_t size){
+    void* memory = std::calloc(count, size);
+    if(memory == nullptr){
+        perror("Table Allocation Failure");
+        exit(EXIT_FAILURE);
+    }
+    return memory;
+}
+
+
+template<class Slot, class Policy>
+class SwissTable{
+
+    public:
+
+    using Key = typename Policy::Key;
+
+    // capacity is a power of two and at least one group
+    explicit SwissTable(size_t capacity){
+        m_table = make_table(capacity);
+    }
+
+    // what the slots own is left alone, a shard's table and the allocator its slots point
+    // into both go away at thread exit, in no fixed order
+    ~SwissTable(){
+        free_table(m_table);
+        free_table(m_old);
+    }
+
+    SwissTable(const SwissTable&) = delete;
+    SwissTable& operator=(const SwissTable&) = delete;
+
+    size_t size() const{
+        return m_table.size + m_old.size;
+    }
+
+    size_t capacity() const{
+        return m_table.capacity;
+    }
+
+    // looks in the new table first, then in the one still being migrated
+    // the slot stays put until the next operation on the table
+    Slot* find(Key key, uint64_t hash){
+        rehash_step(Policy::REHASH_STEP);
+
+        Slot* slot = find_in(m_table, key, hash);
+        if(slot != nullptr || m_old.slots == nullptr) return slot;
+        return find_in(m_old, key, hash);
+    }
+
+    // the key must not be in either table yet
+    Slot* insert(const Slot& slot){
+        rehash_step(Policy::REHASH_STEP);
+
+        // out of empty slots, grow unless it is mostly tombstones that a same size rebuild drops
+        if(m_table.growth_left == 0){
+            size_t live = size();
+            resize(live * 2 >= max_load(m_table.capacity) ? m_table.capacity * 2 : m_table.capacity);
+        }
+        return place(slot);
+    }
+
+    bool erase(Key key, uint64_t hash){
+        rehash_step(Policy::REHASH_STEP);
+
+        Slot* slot = find_in(m_table, key, hash);
+        if(slot != nullptr){
+            if(erase_slot(m_table, slot - m_table.slots)) ++m_table.growth_left;
+            --m_table.size;
+            return true;
+        }
+
+        if(m_old.slots == nullptr) return false;
+        slot = find_in(m_old, key, hash);
+        if(slot == nullptr) return false;
+        erase_slot(m_old, slot - m_old.slots);
+        --m_old.size;
+        return true;
+    }
+
+    // calls f with every live slot of both tables
+    template<class F>
+    void for_each(F&& f){
+        for(size_t i = 0; i < m_table.capacity; ++i){
+            if(ctrlFull(m_table.ctrl[i])) f(m_table.slots[i]);
+        }
+        for(size_t i = 0; i < m_old.capacity; ++i){
+            if(ctrlFull(m_old.ctrl[i])) f(m_old.slots[i]);
+        }
+    }
+
+    bool rehashing() const{
+        return m_old.slots != nullptr;
+    }
+
+    // moves the next slots old slots into the new table, a moved slot becomes a tombstone
+    // so lookups for keys that have not moved yet still probe past it
+    void rehash_step(size_t slots){
+        if(m_old.slots == nullptr) return;
+
+        size_t end = std::min(m_rehash_index + slots, m_old.capacity);
+        for(size_t i = m_rehash_index; i < end; ++i){
+            if(!ctrlFull(m_old.ctrl[i])) continue;
+
+            place(m_old.slots[i]);
+            m_old.slots[i] = Slot{};
+            m_old.ctrl[i] = CTRL_DELETED;
+            --m_old.size;
+        }
+        m_rehash_index = end;
+
+        if(m_rehash_index == m_old.capacity){
+            free_table(m_old);
+            m_old = Table{};
+        }
+    }
+
+    // idle time migration, gives up once the budget is spent
+    void rehash_for(std::chrono::microseconds budget){
+        auto deadline = std::chrono::steady_clock::now() + budget;
+        while(rehashing() && std::chrono::steady_clock::now() < deadline){
+            rehash_step(1024);
+        }
+    }
+
+    private:
+
+    struct Table{
+        Slot* slots = nullptr;
+        uint8_t* ctrl = nullptr;
+        size_t size = 0;
+        size_t capacity = 0;        // power of two, whole 16 slot groups
+        size_t growth_left = 0;     // empty slots that can still be filled before the table grows
+    };
+
+    Table m_table;
+    Table m_old;                    // while growing, slots that still have to move over
+    size_t m_rehash_index = 0;      // next old slot to migrate
+
+    static size_t max_load(size_t capacity){
+        return capacity / 100 * Policy::MAX_LOAD_PERCENT + capacity % 100 * Policy::MAX_LOAD_PERCENT / 100;
+    }
+
+    static Table make_table(size_t capacity){
+        Table table;
+        table.slots = static_cast<Slot*>(allocateTableMemory(capacity, sizeof(Slot)));
+        table.ctrl = static_cast<uint8_t*>(allocateTableMemory(capacity, 1));
+        table.capacity = capacity;
+        table.growth_left = max_load(capacity);
+        return table;
+    }
+
+    static void free_table(Table& table){
+        std::free(table.slots);
+        std::free(table.ctrl);
+    }
+
+    // a group with an empty slot ends the search, no key was ever pushed past it
+    static Slot* find_in(Table& table, Key key, uint64_t hash){
+        size_t group_mask = table.capacity / GROUP_WIDTH - 1;
+        size_t group = (hash >> 7) & group_mask;
+        uint8_t h2 = ctrlHash(hash);
+
+        for(size_t step = 1; step <= group_mask + 1; ++step){
+            const uint8_t* group_ctrl = table.ctrl + group * GROUP_WIDTH;
+
+            for(uint32_t match = matchGroup(group_ctrl, h2); match != 0; match &= match - 1){
+                Slot* slot = &table.slots[group * GROUP_WIDTH + __builtin_ctz(match)];
+                if(Policy::matches(*slot, key, hash)) return slot;
+            }
+            if(matchGroup(group_ctrl, CTRL_EMPTY) != 0) return nullptr;
+
+            group = Policy::Probe::next(group, step, group_mask);
+        }
+        return nullptr;
+    }
+
+    static size_t find_free(const Table& table, uint64_t hash){
+        size_t group_mask = table.capacity / GROUP_WIDTH - 1;
+        size_t group = (hash >> 7) & group_mask;
+
+        for(size_t step = 1; ; ++step){
+            uint32_t free_slots = matchFree(table.ctrl + group * GROUP_WIDTH);
+            if(free_slots != 0) return group * GROUP_WIDTH + __builtin_ctz(free_slots);
+            group = Policy::Probe::next(group, step, group_mask);
+        }
+    }
+
+    Slot* place(const Slot& slot){
+        uint64_t hash = Policy::hash(slot);
+        size_t index = find_free(m_table, hash);
+        if(m_table.ctrl[index] == CTRL_EMPTY) --m_table.growth_left;
+
+        m_table.ctrl[index] = ctrlHash(hash);
+        m_table.slots[index] = slot;
+        ++m_table.size;
+        return &m_table.slots[index];
+    }
+
+    // a slot can only go back to empty while its group still has another empty slot,
+    // otherwise probes for keys further along would stop here, so it becomes a tombstone
+    // returns true when the slot is empty again
+    static bool erase_slot(Table& table, size_t index){
+        const uint8_t* group_ctrl = table.ctrl + index / GROUP_WIDTH * GROUP_WIDTH;
+        bool reusable = matchGroup(group_ctrl, CTRL_EMPTY) != 0;
+
+        table.ctrl[index] = reusable ? CTRL_EMPTY : CTRL_DELETED;
+        Policy::release(table.slots[index]);
+        table.slots[index] = Slot{};
+        return reusable;
+    }
+
+    // allocates the new table and starts moving slots over incrementally,
+    // every table operation and the idle event loop move a few slots each
+    void resize(size_t new_capacity){
+        // a growth that comes before the previous one finished completes it first
+        if(m_old.slots != nullptr) rehash_step(m_old.capacity);
+
+        m_old = m_table;
+        m_table = make_table(new_capacity);
+        m_rehash_index = 0;
+    }
+};
+
+#endif
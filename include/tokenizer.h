@@ -0,0 +1,33 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+
+// helpers for the arguments of a command line, splitting the line is done in scan.h
+// tokens are views into the connection's read buffer, they stay valid until the
+// command has been executed and the buffer is consumed
+
+
+inline bool isCommandSpace(char c){
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+// upper is expected in upper case, avoids upper-casing the command into a copy
+inline bool equalsIgnoreCase(std::string_view token, std::string_view upper){
+    if(token.size() != upper.size()) return false;
+    for(size_t i = 0; i < token.size(); ++i){
+        char c = token[i];
+        if(c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if(c != upper[i]) return false;
+    }
+    return true;
+}
+
+inline bool parseInteger(std::string_view token, int64_t& value){
+    auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == std::errc() && result.ptr == token.data() + token.size();
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+
+// thin wrapper over the raw io_uring syscalls, liburing is not required
+
+
+struct ioUring{
+    int fd;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    io_uring_sqe* sqes;
+    unsigned sq_local_tail;     // sqes handed out but not yet published to the kernel
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+};
+
+struct ioBufferRing{
+    io_uring_buf_ring* ring;
+    char* base;
+    unsigned entries;
+    unsigned buffer_size;
+    uint16_t group;
+};
+
+
+int uringSetup(unsigned entries, io_uring_params* params){
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+int uringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+int uringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args){
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+void initUring(ioUring& ring, unsigned entries){
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ring.fd = uringSetup(entries, &params);
+    if(ring.fd < 0){
+        perror("io_uring_setup");
+        exit(EXIT_FAILURE);
+    }
+
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP)){
+        std::fprintf(stderr, "io_uring: kernel too old, single mmap not supported\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+
+    char* rings = (char*) mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if(rings == MAP_FAILED){
+        perror("io_uring mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    ring.sqes = (io_uring_sqe*) mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if(ring.sqes == MAP_FAILED){
+        perror("io_uring sqe mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    ring.sq_head = (unsigned*)(rings + params.sq_off.head);
+    ring.sq_tail = (unsigned*)(rings + params.sq_off.tail);
+    ring.sq_mask = (unsigned*)(rings + params.sq_off.ring_mask);
+    ring.sq_array = (unsigned*)(rings + params.sq_off.array);
+    ring.sq_local_tail = *ring.sq_tail;
+
+    ring.cq_head = (unsigned*)(rings + params.cq_off.head);
+    ring.cq_tail = (unsigned*)(rings + params.cq_off.tail);
+    ring.cq_mask = (unsigned*)(rings + params.cq_off.ring_mask);
+    ring.cqes = (io_uring_cqe*)(rings + params.cq_off.cqes);
+}
+
+// publishes queued sqes and optionally waits for completions, one syscall for the whole batch
+// everything the kernel has not taken yet is offered again, a partial submit loses nothing
+// returns -errno when the kernel holds off (EBUSY while completions overflow, EAGAIN), the caller
+// has to reap completions before the rest can go in
+int submitUring(ioUring& ring, unsigned wait_for){
+    unsigned to_submit = ring.sq_local_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(ring.sq_tail, ring.sq_local_tail, __ATOMIC_RELEASE);
+
+    if(to_submit == 0 && wait_for == 0) return 0;
+
+    int ret = uringEnter(ring.fd, to_submit, wait_for, wait_for ? IORING_ENTER_GETEVENTS : 0);
+    if(ret < 0){
+        if(errno == EINTR || errno == EAGAIN || errno == EBUSY) return -errno;
+        perror("io_uring_enter");
+        exit(EXIT_FAILURE);
+    }
+    return ret;
+}
+
+bool sqFull(ioUring& ring){
+    return ring.sq_local_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) > *ring.sq_mask;
+}
+
+// nullptr while the submission queue stays full after a flush, the caller keeps the
+// operation and tries again once the completion queue has been drained
+io_uring_sqe* getSqe(ioUring& ring){
+    if(sqFull(ring)){
+        submitUring(ring, 0);
+        if(sqFull(ring)) return nullptr;
+    }
+
+    unsigned index = ring.sq_local_tail & *ring.sq_mask;
+    ring.sq_array[index] = index;
+    ++ring.sq_local_tail;
+
+    io_uring_sqe* sqe = &ring.sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// returns the next completion or nullptr, call seenCqe once it is handled
+io_uring_cqe* peekCqe(ioUring& ring){
+    unsigned head = *ring.cq_head;
+    if(head == __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) return nullptr;
+    return &ring.cqes[head & *ring.cq_mask];
+}
+
+void seenCqe(ioUring& ring){
+    __atomic_store_n(ring.cq_head, *ring.cq_head + 1, __ATOMIC_RELEASE);
+}
+
+
+// the uapi flex array member gets misplaced when compiled as C++, index the ring memory directly
+io_uring_buf* ringSlot(ioBufferRing& buffers, unsigned index){
+    return (io_uring_buf*) buffers.ring + (index & (buffers.entries - 1));
+}
+
+void initBufferRing(ioUring& ring, ioBufferRing& buffers, uint16_t group, unsigned entries, unsigned buffer_size){
+    buffers.group = group;
+    buffers.entries = entries;  // must be a power of two
+    buffers.buffer_size = buffer_size;
+
+    size_t ring_bytes = entries * sizeof(io_uring_buf);
+    buffers.ring = (io_uring_buf_ring*) mmap(nullptr, ring_bytes, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(buffers.ring == MAP_FAILED){
+        perror("Buffer Ring mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    buffers.base = new char[(size_t)entries * buffer_size];
+
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) buffers.ring;
+    reg.ring_entries = entries;
+    reg.bgid = group;
+
+    if(uringRegister(ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0){
+        perror("io_uring register buffer ring");
+        exit(EXIT_FAILURE);
+    }
+
+    buffers.ring->tail = 0;
+    for(unsigned i = 0; i < entries; ++i){
+        io_uring_buf* buf = ringSlot(buffers, i);
+        buf->addr = (uint64_t)(buffers.base + (size_t)i * buffer_size);
+        buf->len = buffer_size;
+        buf->bid = i;
+    }
+    __atomic_store_n(&buffers.ring->tail, (uint16_t) entries, __ATOMIC_RELEASE);
+}
+
+char* getRingBuffer(ioBufferRing& buffers, uint16_t bid){
+    return buffers.base + (size_t)bid * buffers.buffer_size;
+}
+
+// hands a consumed buffer back to the kernel for the next multishot recv
+void recycleRingBuffer(ioBufferRing& buffers, uint16_t bid){
+    uint16_t tail = buffers.ring->tail;
+    io_uring_buf* buf = ringSlot(buffers, tail);
+    buf->addr = (uint64_t) getRingBuffer(buffers, bid);
+    buf->len = buffers.buffer_size;
+    buf->bid = bid;
+    __atomic_store_n(&buffers.ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+#endif
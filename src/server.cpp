@@ -1,9 +1,88 @@
 #include <server.h>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
 
                                                 
-int main(){
-    std::cout << "Starting Server on port 5555\n";
-    redisServer server(5555);
+int main(int argc, char** argv){
+    int port = 5555;
+    int threads = 1;
+    int io_threads = 1;
+    Backend backend = Backend::Epoll;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(std::strcmp(argv[i], "--port") == 0){
+            port = std::atoi(argv[i + 1]);
+        }else if(std::strcmp(argv[i], "--threads") == 0){
+            threads = std::atoi(argv[i + 1]);
+        }else if(std::strcmp(argv[i], "--io-threads") == 0){
+            io_threads = std::atoi(argv[i + 1]);
+        }else if(std::strcmp(argv[i], "--capacity") == 0){
+            // slots per shard, rounded up to a power of two
+            // strtoull would wrap "-1" to 2^64-1, only plain digits are taken
+            char* end;
+            errno = 0;
+            unsigned long long slots = std::strtoull(argv[i + 1], &end, 10);
+            if(!std::isdigit((unsigned char) argv[i + 1][0]) || *end != '\0' || slots == 0){
+                std::cout << "Invalid Capacity: " << argv[i + 1] << "\n";
+                return EXIT_FAILURE;
+            }
+            if(errno == ERANGE || slots > MAX_TABLE_CAPACITY){
+                std::cout << "Capacity limited to " << MAX_TABLE_CAPACITY << " slots\n";
+                slots = MAX_TABLE_CAPACITY;
+            }
+            KeyspaceCapacity = tableCapacity(slots);
+        }else if(std::strcmp(argv[i], "--list-pack-entries") == 0){
+            // lists up to these limits stay packed in their keyspace entry
+            ListPackMaxEntries = std::strtoull(argv[i + 1], nullptr, 10);
+        }else if(std::strcmp(argv[i], "--list-pack-bytes") == 0){
+            ListPackMaxBytes = std::strtoull(argv[i + 1], nullptr, 10);
+        }else if(std::strcmp(argv[i], "--backend") == 0){
+            if(std::strcmp(argv[i + 1], "uring") == 0){
+                backend = Backend::Uring;
+            }else if(std::strcmp(argv[i + 1], "epoll") != 0){
+                std::cout << "Unknown Backend: " << argv[i + 1] << "\n";
+                return EXIT_FAILURE;
+            }
+        }else{
+            std::cout << "Unknown Option: " << argv[i] << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(io_threads > 1 && backend != Backend::Epoll){
+        std::cout << "--io-threads needs the epoll backend\n";
+        return EXIT_FAILURE;
+    }
+
+    // shared by all shards, routing a key only works if every thread hashes it the same way
+    seedHash();
+
+    if(threads <= 1){
+        std::cout << "Starting Server on port " << port << "\n";
+        redisServer server(port, false, backend, io_threads);
+        server.run_server();
+        return 0;
+    }
+
+    // one reactor per thread, each with its own SO_REUSEPORT listener, epoll fd and clients
+    // and one shard of the keyspace, pinned to its own core
+    std::cout << "Starting " << threads << " Shards on port " << port << "\n";
+    ShardSet<redisServer::ShardTask> shards(threads);
+    std::vector<std::thread> reactors;
+    for(int i = 1; i < threads; ++i){
+        reactors.emplace_back([port, backend, io_threads, &shards, i](){
+            pinToCore(i);
+            redisServer server(port, true, backend, io_threads, &shards, i);
+            server.run_server();
+        });
+    }
+
+    pinToCore(0);
+    redisServer server(port, true, backend, io_threads, &shards, 0);
     server.run_server();
-    
-}
\ No newline at end of file
+
+    for(auto& t: reactors) t.join();
+}
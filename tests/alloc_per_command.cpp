@@ -0,0 +1,120 @@
+#include <server.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <thread>
+#include <new>
+#include <cstdlib>
+
+// counts heap allocations made by the server thread while it serves GET and SET of an
+// existing key over a real connection, after warm-up neither may allocate
+
+
+static std::atomic<size_t> Allocations{0};
+static thread_local bool CountAllocations = false;
+
+void* operator new(size_t size){
+    if(CountAllocations) Allocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept{ std::free(p); }
+void operator delete[](void* p) noexcept{ std::free(p); }
+void operator delete(void* p, size_t) noexcept{ std::free(p); }
+void operator delete[](void* p, size_t) noexcept{ std::free(p); }
+
+
+static int connectTo(int port){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0){
+        perror("connect");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// one request, waits for the whole reply so the server is idle again afterwards
+static void roundTrip(int fd, std::string_view request, std::string_view reply){
+    if(write(fd, request.data(), request.size()) != (ssize_t) request.size()){
+        perror("write");
+        exit(EXIT_FAILURE);
+    }
+
+    std::string got;
+    char buffer[256];
+    while(got.size() < reply.size()){
+        ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        if(bytes <= 0){
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+        got.append(buffer, bytes);
+    }
+
+    if(got != reply){
+        std::cerr << "unexpected reply to " << request << ": " << got << "\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+static size_t allocationsFor(int fd, std::string_view request, std::string_view reply, int rounds){
+    size_t before = Allocations.load();
+    for(int i = 0; i < rounds; ++i) roundTrip(fd, request, reply);
+    return Allocations.load() - before;
+}
+
+
+int main(){
+    seedHash();
+
+    // an ephemeral port, read back from the listening socket
+    redisServer* server = new redisServer(0);
+    sockaddr_in addr{};
+    socklen_t addr_len = sizeof(addr);
+    getsockname(server->m_server_fd, (sockaddr*)&addr, &addr_len);
+    int port = ntohs(addr.sin_port);
+
+    std::thread([server](){
+        CountAllocations = true;
+        server->run_server();
+    }).detach();
+
+    int fd = connectTo(port);
+    const char* set_text = "SET counter 0000000001\n";
+    const char* set_resp = "*3\r\n$3\r\nSET\r\n$7\r\ncounter\r\n$10\r\n0000000002\r\n";
+    const char* get_resp = "*2\r\n$3\r\nGET\r\n$7\r\ncounter\r\n";
+
+    // first commands create the key, the client state and the reply segments
+    for(int i = 0; i < 64; ++i){
+        roundTrip(fd, set_text, "OK\n");
+        roundTrip(fd, "GET counter\n", "0000000001\n");
+    }
+
+    int failures = 0;
+    auto check = [&failures](const char* name, size_t count){
+        std::cout << "\n" << name << ": " << count << " allocations\n";
+        if(count != 0) ++failures;
+    };
+
+    check("text GET", allocationsFor(fd, "GET counter\n", "0000000001\n", 1000));
+    check("text SET existing key", allocationsFor(fd, set_text, "OK\n", 1000));
+
+    // RESP on its own connection, the protocol is fixed by the first byte
+    int resp_fd = connectTo(port);
+    for(int i = 0; i < 64; ++i){
+        roundTrip(resp_fd, set_resp, "+OK\r\n");
+        roundTrip(resp_fd, get_resp, "$10\r\n0000000002\r\n");
+    }
+    check("RESP GET", allocationsFor(resp_fd, get_resp, "$10\r\n0000000002\r\n", 1000));
+    check("RESP SET existing key", allocationsFor(resp_fd, set_resp, "+OK\r\n", 1000));
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
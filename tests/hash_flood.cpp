@@ -0,0 +1,84 @@
+#include "hash.h"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_set>
+
+// keys that zero one factor of a multiply used to collapse to a single seed independent hash
+// every family below has to spread over distinct hashes, and differently under every seed
+
+
+static constexpr size_t KEYS_PER_FAMILY = 4096;
+
+static int Failures = 0;
+
+static void putRead32(std::string& key, size_t at, uint32_t value){
+    std::memcpy(&key[at], &value, 4);
+}
+
+static void putRead64(std::string& key, size_t at, uint64_t value){
+    std::memcpy(&key[at], &value, 8);
+}
+
+// random keys of length len with the bytes set by fix kept the same in all of them
+template<typename Fix>
+static void checkFamily(const char* name, size_t len, uint64_t seed, Fix fix){
+    HashSecret secret = makeHashSecret(seed);
+    HashSecret other = makeHashSecret(seed + 1);
+    std::mt19937_64 rng(seed);
+    std::unordered_set<uint64_t> hashes;
+    size_t same_across_seeds = 0;
+
+    for(size_t i = 0; i < KEYS_PER_FAMILY; ++i){
+        std::string key(len, '\0');
+        for(char& c: key) c = (char) rng();
+        fix(key);
+
+        uint64_t hash = hashBytes(key.data(), key.size(), secret);
+        hashes.insert(hash);
+        if(hash == hashBytes(key.data(), key.size(), other)) ++same_across_seeds;
+    }
+
+    if(hashes.size() != KEYS_PER_FAMILY || same_across_seeds != 0){
+        std::printf("%s, seed %llx: %zu distinct hashes for %zu keys, %zu unchanged by the seed\n", name,
+                    (unsigned long long) seed, hashes.size(), KEYS_PER_FAMILY, same_across_seeds);
+        ++Failures;
+    }
+}
+
+
+int main(){
+    for(uint64_t seed: {1ull, 0xdeadbeefull, 123456789ull}){
+        HashSecret secret = makeHashSecret(seed);
+
+        // the reported set, bytes 0..3 and 8..11 spelled the old public secret
+        checkFamily("public constant", 16, seed, [](std::string& key){
+            putRead32(key, 0, 0x8bb84b93);
+            putRead32(key, 8, 0x962eacc9);
+        });
+
+        // the same attack with this seed's own secret, as if it had leaked
+        checkFamily("leaked secret, short key", 16, seed, [&](std::string& key){
+            putRead32(key, 0, (uint32_t) (secret.secret[1] >> 32));
+            putRead32(key, 8, (uint32_t) secret.secret[1]);
+        });
+
+        // a block that zeroes the multiply inside the 16 byte loop
+        checkFamily("leaked secret, loop block", 32, seed, [&](std::string& key){
+            putRead64(key, 0, secret.secret[1]);
+            putRead64(key, 16, 0);
+            putRead64(key, 24, 0);
+        });
+
+        // the same in the first lane of the 48 byte loop
+        checkFamily("leaked secret, lane block", 64, seed, [&](std::string& key){
+            putRead64(key, 0, secret.secret[1]);
+            putRead64(key, 16, secret.secret[2]);
+            putRead64(key, 32, secret.secret[3]);
+        });
+    }
+
+    std::printf("%d failures\n", Failures);
+    return Failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,89 @@
+#include "dict.h"
+#include "llist.h"
+#include <random>
+#include <string>
+#include <unordered_map>
+
+// millions of mixed SET/DEL on one keyspace, checked against a plain unordered_map
+// deleted slots have to be reused and every live key has to stay reachable through
+// growth, incremental migration and the deletes that happen in the middle of it
+
+
+static constexpr size_t KEY_SPACE = 200000;
+static constexpr size_t OPERATIONS = 2000000;
+static constexpr size_t CHECK_EVERY = 250000;
+
+static int Failures = 0;
+
+static void fail(const std::string& what){
+    if(++Failures <= 10) std::cerr << what << "\n";
+}
+
+// short values stay in the slot, long ones go to the slabs
+static std::string valueFor(size_t key, size_t op){
+    std::string value = std::to_string(key * 31 + op);
+    if(op % 4 == 0) value.append(40 + op % 50, 'v');
+    return value;
+}
+
+static void checkAll(const std::unordered_map<std::string, std::string>& model){
+    for(const auto& [key, value]: model){
+        std::string_view found;
+        if(getString(key, found) != KeyResult::Found){
+            fail("missing key " + key);
+        }else if(found != value){
+            fail("wrong value for " + key);
+        }
+    }
+
+    if(Keyspace.size() != model.size()){
+        fail("keyspace holds " + std::to_string(Keyspace.size()) + " keys, expected " + std::to_string(model.size()));
+    }
+
+    std::vector<std::string_view> keys;
+    getKeys(keys, EntryType::String);
+    if(keys.size() != model.size()) fail("KEYS returned " + std::to_string(keys.size()) + " keys");
+}
+
+
+int main(){
+    seedHash();
+
+    std::mt19937_64 rng(12345);
+    std::unordered_map<std::string, std::string> model;
+    size_t peak = 0;
+
+    for(size_t op = 0; op < OPERATIONS; ++op){
+        size_t id = rng() % KEY_SPACE;
+        std::string key = "key:" + std::to_string(id);
+
+        // slightly more sets than deletes, the live set drifts up and the table grows mid-churn
+        if(rng() % 100 < 55){
+            std::string value = valueFor(id, op);
+            setString(key, value);
+            model[key] = value;
+        }else{
+            bool existed = model.erase(key) > 0;
+            if(delKey(key) != existed) fail("DEL " + key + " returned " + (existed ? "0" : "1"));
+
+            std::string_view found;
+            if(getString(key, found) != KeyResult::MissingKey) fail("deleted key still found " + key);
+        }
+
+        peak = std::max(peak, model.size());
+        if((op + 1) % CHECK_EVERY == 0) checkAll(model);
+    }
+
+    // churn must not grow the table past what the live keys need
+    while(keyspaceRehashing()) rehashKeyspaceFor(std::chrono::microseconds(1000));
+    if(Keyspace.capacity() > tableCapacity(peak) * 4){
+        fail("capacity " + std::to_string(Keyspace.capacity()) + " for at most " + std::to_string(peak) + " keys");
+    }
+
+    for(const auto& [key, value]: model) delKey(key);
+    model.clear();
+    checkAll(model);
+
+    std::cout << "peak " << peak << " keys, capacity " << Keyspace.capacity() << ", " << Failures << " failures\n";
+    return Failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
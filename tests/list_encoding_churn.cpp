@@ -0,0 +1,77 @@
+#include "dict.h"
+#include "llist.h"
+#include <random>
+#include <string>
+
+// a long list alternating short runs of LGET with runs of pushes used to move between the
+// chunk and ring encodings every round, copying the whole list each time
+// conversions have to stay amortized: at most one per list length worth of operations
+
+
+static constexpr size_t LIST_SIZE = 50000;
+static constexpr size_t ROUNDS = 100;
+static constexpr size_t GETS_PER_ROUND = 16;
+static constexpr size_t PUSHES_PER_ROUND = 300;
+
+static int Failures = 0;
+
+static void fail(const std::string& what){
+    if(++Failures <= 10) std::cerr << what << "\n";
+}
+
+static List* listOf(std::string_view key){
+    Entry* e;
+    if(findList(key, e) != KeyResult::Found || e->packed) return nullptr;
+    return entryObject<List>(*e);
+}
+
+static std::string element(size_t i){
+    return "element:" + std::to_string(i);
+}
+
+
+int main(){
+    seedHash();
+
+    for(size_t i = 0; i < LIST_SIZE; ++i) pushBackList("list", element(i));
+
+    std::mt19937_64 rng(7);
+    size_t size = LIST_SIZE, operations = 0, conversions = 0;
+    ListEncoding encoding = listOf("list")->encoding;
+    std::string scratch;
+
+    auto countConversion = [&](){
+        List* list = listOf("list");
+        if(list->encoding != encoding) ++conversions;
+        encoding = list->encoding;
+    };
+
+    for(size_t round = 0; round < ROUNDS; ++round){
+        for(size_t i = 0; i < GETS_PER_ROUND; ++i){
+            size_t index = rng() % size;
+            std::string_view value;
+            if(getListR("list", (int64_t) index, value, scratch) != KeyResult::Found || value != element(index)){
+                fail("LGET " + std::to_string(index) + " returned the wrong element");
+            }
+        }
+        countConversion();
+
+        for(size_t i = 0; i < PUSHES_PER_ROUND; ++i) pushBackList("list", element(size++));
+        countConversion();
+        operations += GETS_PER_ROUND + PUSHES_PER_ROUND;
+    }
+
+    if(conversions > operations / LIST_SIZE + 1){
+        fail(std::to_string(conversions) + " conversions in " + std::to_string(operations) + " operations");
+    }
+
+    // index heavy access still moves the list to the ring once it has paid for it
+    for(size_t i = 0; i < 2 * size && listOf("list")->encoding != ListEncoding::Ring; ++i){
+        std::string_view value;
+        getListR("list", (int64_t) (i % 8), value, scratch);
+    }
+    if(listOf("list")->encoding != ListEncoding::Ring) fail("index heavy list never moved to the ring");
+
+    std::cout << conversions << " conversions in " << operations << " operations, " << Failures << " failures\n";
+    return Failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}